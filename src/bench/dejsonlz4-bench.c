@@ -0,0 +1,340 @@
+/*
+   dejsonlz4-bench - Measure the LZ4 decompression and compression speed
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+
+/*
+   lz4.c and lz4.h are based on copies from Mozilla source tree mfbt/lz4.*
+   (Mercurial) rev: c3f5e6079284 (2016-05-12), with local performance changes,
+   and carry their own license.
+*/
+
+/* Build: gcc -Wall -O2 -Isrc -o dejsonlz4-bench src/bench/dejsonlz4-bench.c src/mozlz4.c src/lz4.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+
+#include "lz4.h"
+#include "mozlz4.h"
+
+void exit_usage(int code) {
+    fprintf((code ? stderr : stdout), "%s",
+            "Usage: dejsonlz4-bench [-h] [-n N] [-w N] [--csv | --json] FILE...\n"
+            "   -h  Display this help and exit.\n"
+            "   -n N  Time N iterations of each function (default 10).\n"
+            "   -w N  Run N untimed iterations first (default 2).\n"
+            "   --csv  Print the results as CSV, with a header line.\n"
+            "   --json  Print one JSON object per line instead.\n"
+            "Measure LZ4_decompress_safe, LZ4_decompress_fast and LZ4_compress with\n"
+            "each FILE: its LZ4 block if it's a mozLz40 file, or else its content\n"
+            "(which is compressed with LZ4_compress first).\n"
+            "Speeds are of the decompressed size, in MB/s (10^6 bytes), from the median\n"
+            "iteration time. The iteration times are printed as percentiles, in us.\n"
+           );
+    exit(code);
+}
+
+#define ERR_CLEANUP(...) { fprintf(stderr, "Error: " __VA_ARGS__); goto cleanup; }
+
+#define FORMAT_TEXT  0
+#define FORMAT_CSV   1
+#define FORMAT_JSON  2
+
+/* Returns a monotonic time in ns */
+double now_ns(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER c, f;
+    QueryPerformanceCounter(&c);
+    QueryPerformanceFrequency(&f);
+    return (double)c.QuadPart * 1e9 / f.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+/* Reads fname entirely into a new buffer. Returns it, or NULL on failure */
+char *file_to_mem(const char *fname, size_t *out_size)
+{
+    FILE *f = fopen(fname, "rb");
+    char *data = 0, *p;
+    size_t got = 0, size = 64 * 1024;
+
+    if (!f)
+        return 0;
+    while ((p = realloc(data, size))) {
+        data = p;
+        got += fread(data + got, 1, size - got, f);
+        if (got < size)
+            break;
+        size *= 2;
+    }
+    if (!p || ferror(f)) {
+        free(data);
+        data = 0;
+    }
+    fclose(f);
+    *out_size = got;
+    return data;
+}
+
+/* The data of one file, and the buffers which the functions use */
+typedef struct {
+    const char *block;  /* the LZ4 block */
+    int csize;
+    const char *orig;   /* its decompressed content */
+    int size;
+    char *dst;          /* size bytes, for decompression */
+    char *cdst;         /* LZ4_compressBound(size) bytes, for compression */
+    int result;         /* of the last call */
+} bench_t;
+
+/* Returns non-zero on failure */
+int run_decompress_safe(bench_t *b)
+{
+    return (b->result = LZ4_decompress_safe(b->block, b->dst, b->csize, b->size)) != b->size;
+}
+
+int run_decompress_fast(bench_t *b)
+{
+    return (b->result = LZ4_decompress_fast(b->block, b->dst, b->size)) != b->csize;
+}
+
+int run_compress(bench_t *b)
+{
+    return (b->result = LZ4_compress(b->orig, b->cdst, b->size)) <= 0;
+}
+
+typedef struct {
+    const char *name;
+    int (*run)(bench_t *b);
+} func_t;
+
+const func_t funcs[] = {
+    {"LZ4_decompress_safe", run_decompress_safe},
+    {"LZ4_decompress_fast", run_decompress_fast},
+    {"LZ4_compress", run_compress},
+};
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Returns the p percentile (nearest rank) of the n sorted values t */
+double percentile(const double *t, int n, int p)
+{
+    int k = (n * p + 99) / 100;
+    return t[k ? k - 1 : 0];
+}
+
+/* Checks that the last call of f produced the right output */
+int verify(const func_t *f, bench_t *b)
+{
+    if (f->run == run_compress) {
+        return LZ4_decompress_safe(b->cdst, b->dst, b->result, b->size) != b->size
+               || memcmp(b->dst, b->orig, b->size);
+    }
+    return memcmp(b->dst, b->orig, b->size) != 0;
+}
+
+/* Prints str as a JSON string to f */
+void print_json_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+/* Prints str as a CSV field to f */
+void print_csv_string(FILE *f, const char *str)
+{
+    if (!strpbrk(str, ",\"\r\n")) {
+        fputs(str, f);
+        return;
+    }
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"')
+            fputc('"', f);
+        fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+/* Times each function with the file iname, and prints the results in format.
+ * Returns 0 on success */
+int bench_file(const char *iname, int iters, int warmup, int format, double *t)
+{
+    char *data = 0, *odata = 0;
+    size_t len, size;
+    const char *source;
+    bench_t b = {0};
+    int rv = 1, i, k;
+
+    if (!(data = file_to_mem(iname, &len)))
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+
+    if (!mozlz4_peek_size(data, len, &size)) {
+        source = "mozlz4";
+        if (size > LZ4_MAX_INPUT_SIZE || !(odata = malloc(size + 1)))
+            ERR_CLEANUP("'%s': cannot allocate memory for output\n", iname);
+        if (mozlz4_decode_into(data, len, odata, size, &size))
+            ERR_CLEANUP("'%s': malformed compressed data\n", iname);
+        b.block = data + MOZLZ4_HEADER_SIZE;
+        b.csize = (int)(len - MOZLZ4_HEADER_SIZE);
+        b.orig = odata;
+        b.size = (int)size;
+    } else {
+        source = "raw";
+        if (len > LZ4_MAX_INPUT_SIZE || !(odata = malloc(LZ4_compressBound((int)len) + 1)))
+            ERR_CLEANUP("'%s': cannot allocate memory for output\n", iname);
+        b.csize = LZ4_compress(data, odata, (int)len);
+        b.block = odata;
+        b.orig = data;
+        b.size = (int)len;
+    }
+    if (!b.size) {
+        fprintf(stderr, "Warning: '%s': empty, skipped\n", iname);
+        rv = 0;
+        goto cleanup;
+    }
+    if (!(b.dst = malloc(b.size + 1)) || !(b.cdst = malloc(LZ4_compressBound(b.size) + 1)))
+        ERR_CLEANUP("'%s': cannot allocate memory for output\n", iname);
+
+    for (k = 0; k < (int)(sizeof funcs / sizeof *funcs); k++) {
+        const func_t *f = &funcs[k];
+        double med, ratio;
+
+        for (i = 0; i < warmup; i++)
+            f->run(&b);
+        for (i = 0; i < iters; i++) {
+            double start = now_ns();
+            if (f->run(&b))
+                ERR_CLEANUP("'%s': %s failed\n", iname, f->name);
+            t[i] = now_ns() - start;
+        }
+        if (verify(f, &b))
+            ERR_CLEANUP("'%s': %s produced wrong output\n", iname, f->name);
+
+        qsort(t, iters, sizeof *t, cmp_double);
+        med = percentile(t, iters, 50);
+        ratio = (double)b.size / (f->run == run_compress ? b.result : b.csize);
+
+        if (format == FORMAT_JSON) {
+            printf("{\"file\":");
+            print_json_string(stdout, iname);
+            printf(",\"source\":\"%s\",\"function\":\"%s\",\"size\":%d,\"iterations\":%d,"
+                   "\"mb_s\":%.1f,\"ns_byte\":%.3f,\"p50_us\":%.1f,\"p90_us\":%.1f,"
+                   "\"p99_us\":%.1f,\"ratio\":%.3f}\n",
+                   source, f->name, b.size, iters, b.size * 1e3 / med, med / b.size,
+                   med / 1e3, percentile(t, iters, 90) / 1e3, percentile(t, iters, 99) / 1e3, ratio);
+        } else if (format == FORMAT_CSV) {
+            print_csv_string(stdout, iname);
+            printf(",%s,%s,%d,%d,%.1f,%.3f,%.1f,%.1f,%.1f,%.3f\n",
+                   source, f->name, b.size, iters, b.size * 1e3 / med, med / b.size,
+                   med / 1e3, percentile(t, iters, 90) / 1e3, percentile(t, iters, 99) / 1e3, ratio);
+        } else {
+            printf("%-20s %10d %9.1f %7.3f %10.1f %10.1f %10.1f %7.3f  %s\n",
+                   f->name, b.size, b.size * 1e3 / med, med / b.size,
+                   med / 1e3, percentile(t, iters, 90) / 1e3, percentile(t, iters, 99) / 1e3,
+                   ratio, iname);
+        }
+    }
+    rv = 0;
+
+cleanup:
+    fflush(stdout);
+    free(b.cdst);
+    free(b.dst);
+    free(odata);
+    free(data);
+    return rv;
+}
+
+int main(int argc, char **argv)
+{
+    int i, iters = 10, warmup = 2, format = FORMAT_TEXT, failed = 0;
+    double *t;
+
+    /* process arguments */
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (!strcmp(argv[i], "-h"))
+            exit_usage(0);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            if ((iters = atoi(argv[++i])) < 1)
+                exit_usage(1);
+        }
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            if ((warmup = atoi(argv[++i])) < 0)
+                exit_usage(1);
+        }
+        else if (!strcmp(argv[i], "--csv"))
+            format = FORMAT_CSV;
+        else if (!strcmp(argv[i], "--json"))
+            format = FORMAT_JSON;
+        else
+            exit_usage(1);
+    }
+    if (i == argc)
+        exit_usage(1);
+    if (!(t = malloc(iters * sizeof *t))) {
+        fprintf(stderr, "Error: cannot allocate memory\n");
+        return 1;
+    }
+
+    if (format == FORMAT_CSV)
+        printf("file,source,function,size,iterations,mb_s,ns_byte,p50_us,p90_us,p99_us,ratio\n");
+    else if (format == FORMAT_TEXT)
+        printf("%-20s %10s %9s %7s %10s %10s %10s %7s  %s\n",
+               "function", "size", "MB/s", "ns/B", "p50 us", "p90 us", "p99 us", "ratio", "file");
+    for (; i < argc; i++)
+        failed += bench_file(argv[i], iters, warmup, format, t) != 0;
+
+    free(t);
+    return failed != 0;
+}
@@ -0,0 +1,473 @@
+/*
+   dejsonlz4-gen - Generate synthetic Firefox bookmarks and session JSON
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+
+/*
+   lz4.c and lz4.h are based on copies from Mozilla source tree mfbt/lz4.*
+   (Mercurial) rev: c3f5e6079284 (2016-05-12), with local performance changes,
+   and carry their own license.
+*/
+
+/* Build: gcc -Wall -O2 -Isrc -o dejsonlz4-gen src/bench/dejsonlz4-gen.c src/lz4.c */
+
+/*
+   The output has the structure of Firefox bookmarks backups and sessionstore
+   files, with made up content: titles from a word list, URLs from a pool of
+   sites (so that hosts repeat, as they do in real profiles), and a base64
+   favicon per site on some of the items. All of it comes from a seeded PRNG,
+   and the same options always produce the same bytes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "lz4.h"
+
+void exit_usage(int code) {
+    fprintf((code ? stderr : stdout), "%s",
+            "Usage: dejsonlz4-gen [-h] [-z] [--seed N] bookmarks [-b N] [-d N] OUT_FILE\n"
+            "       dejsonlz4-gen [-h] [-z] [--seed N] session [-w N] [-t N] [-H N] OUT_FILE\n"
+            "   -h  Display this help and exit.\n"
+            "   -z  Write mozLz40 (as jsonlz4 does), instead of JSON.\n"
+            "   --seed N  Seed of the generated content (default 1).\n"
+            "   bookmarks  A bookmarks backup:\n"
+            "      -b N  Number of bookmarks (default 1000).\n"
+            "      -d N  Depth of nested folders (default 3).\n"
+            "   session  A sessionstore file:\n"
+            "      -w N  Number of windows (default 2).\n"
+            "      -t N  Number of tabs, over all windows (default 100).\n"
+            "      -H N  History entries per tab (default 5).\n"
+            "Generate synthetic Firefox JSON data to OUT_FILE, for benchmarks.\n"
+            "If OUT_FILE is '-', write to standard output.\n"
+           );
+    exit(code);
+}
+
+/* If required, prevents EOL translations with f. Returns non-zero on failure */
+int ensure_binary(FILE *f)
+{
+#ifdef _WIN32
+    /* -1 is failure: https://msdn.microsoft.com/en-us/library/tw4k6df8.aspx */
+    return _setmode(_fileno(f), O_BINARY) == -1;
+#else
+    (void)f;
+    return 0;  /* not required */
+#endif
+}
+
+#define ERR_CLEANUP(...) { fprintf(stderr, "Error: " __VA_ARGS__); goto cleanup; }
+
+const char mozlz4_magic[] = {109, 111, 122, 76, 122, 52, 48, 0};  /* "mozLz40\0" */
+
+/* xorshift64* */
+unsigned long long rng_state = 1;
+
+unsigned rnd(unsigned n)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned)((rng_state * 2685821657736338717ULL) >> 33) % n;
+}
+
+/*
+   Output: JSON is written to the file in chunks of FLUSH_SIZE, unless it's
+   compressed, and then it's kept in memory till the end.
+*/
+#define FLUSH_SIZE (1024 * 1024)
+
+typedef struct {
+    char *data;
+    size_t len, size;
+    FILE *f;      /* NULL to keep everything */
+    int failed;   /* OOM or write error */
+} out_t;
+
+void out_flush(out_t *o)
+{
+    if (o->f && o->len) {
+        if (fwrite(o->data, 1, o->len, o->f) != o->len)
+            o->failed = 1;
+        o->len = 0;
+    }
+}
+
+void out_printf(out_t *o, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(o->data + o->len, o->size - o->len, fmt, ap);
+        va_end(ap);
+        if (n < 0 || o->failed) {
+            o->failed = 1;
+            return;
+        }
+        if ((size_t)n < o->size - o->len)
+            break;
+        {
+            size_t size = o->size ? o->size * 2 : FLUSH_SIZE * 2;
+            char *p = realloc(o->data, size);
+            if (!p) {
+                o->failed = 1;
+                return;
+            }
+            o->data = p;
+            o->size = size;
+        }
+    }
+    o->len += n;
+    if (o->f && o->len >= FLUSH_SIZE)
+        out_flush(o);
+}
+
+/* Content */
+const char *words[] = {
+    "news", "home", "the", "of", "and", "weather", "guide", "how", "to", "best",
+    "review", "free", "online", "video", "music", "recipe", "docs", "api", "release",
+    "notes", "download", "forum", "blog", "search", "results", "map", "travel", "shop",
+    "sale", "support", "account", "login", "settings", "page", "wiki", "project",
+    "issue", "report", "daily", "world", "sports", "science", "Firefox", "Mozilla",
+    "tutorial", "introduction", "reference", "2016", "2017", "new", "top", "10",
+    "caf\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac", "\xd0\xbd\xd0\xbe\xd0\xb2\xd0\xbe\xd1\x81\xd1\x82\xd0\xb8",
+};
+#define NWORDS (sizeof words / sizeof *words)
+
+const char *tlds[] = {"com", "org", "net", "de", "co.uk", "io", "fr", "jp"};
+#define NTLDS (sizeof tlds / sizeof *tlds)
+
+#define NSITES 200
+
+typedef struct {
+    char host[48];
+    char *icon;  /* base64 PNG data, or NULL */
+} site_t;
+
+site_t sites[NSITES];
+
+const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const char guid_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/* Returns non-zero on OOM */
+int init_sites(void)
+{
+    int i, k;
+    for (i = 0; i < NSITES; i++) {
+        site_t *s = &sites[i];
+        snprintf(s->host, sizeof s->host, "%s%s%s.%s", rnd(3) ? "www." : "",
+                 words[rnd(NWORDS - 3)], words[rnd(NWORDS - 3)], tlds[rnd(NTLDS)]);
+        if (rnd(2)) {
+            /* a PNG header and then mostly incompressible bytes, as real icons */
+            static const char png[] = "iVBORw0KGgoAAAANSUhEUgAAABAAAAAQCAYAAAAf8/9h";
+            int len = 200 + rnd(8) * 100;
+            if (!(s->icon = malloc(sizeof png + len + 2)))
+                return 1;
+            memcpy(s->icon, png, sizeof png - 1);
+            for (k = 0; k < len; k++)
+                s->icon[sizeof png - 1 + k] = b64[rnd(64)];
+            strcpy(s->icon + sizeof png - 1 + len, "==");
+        }
+    }
+    return 0;
+}
+
+void put_title(out_t *o, int nwords)
+{
+    int i;
+    for (i = 0; i < nwords; i++)
+        out_printf(o, i ? " %s" : "%s", words[rnd(NWORDS)]);
+}
+
+void put_url(out_t *o, const site_t *s)
+{
+    int i, n = rnd(4);
+    out_printf(o, "http%s://%s/", rnd(5) ? "s" : "", s->host);
+    for (i = 0; i < n; i++)
+        out_printf(o, i ? "/%s" : "%s", words[rnd(NWORDS - 3)]);
+    if (!rnd(3))
+        out_printf(o, "?id=%u", rnd(100000));
+}
+
+void put_guid(out_t *o)
+{
+    char g[13];
+    int i;
+    for (i = 0; i < 12; i++)
+        g[i] = guid_chars[rnd(64)];
+    g[12] = 0;
+    out_printf(o, "\"%s\"", g);
+}
+
+void put_uuid(out_t *o)
+{
+    out_printf(o, "\"{%08x-%04x-%04x-%04x-%04x%08x}\"", rnd(0xffffffffU), rnd(0x10000),
+               0x4000 | rnd(0x1000), 0x8000 | rnd(0x4000), rnd(0x10000), rnd(0xffffffffU));
+}
+
+/* PRTime: microseconds since the epoch, in 2016-2017 */
+unsigned long long prtime(void)
+{
+    return 1451606400000000ULL + (unsigned long long)rnd(1000000000) * 63000;
+}
+
+/*
+   Bookmarks: the root folder, with the menu, toolbar, unfiled and mobile
+   folders, and bookmarks spread over them and over nested folders.
+*/
+typedef struct {
+    int left;   /* bookmarks to write */
+    int id;
+    int depth;  /* of nested folders */
+} bm_t;
+
+void put_item_head(out_t *o, bm_t *b, int index)
+{
+    unsigned long long added = prtime();
+    out_printf(o, "{\"guid\":");
+    put_guid(o);
+    out_printf(o, ",\"title\":\"");
+    put_title(o, 1 + rnd(6));
+    out_printf(o, "\",\"index\":%d,\"dateAdded\":%llu,\"lastModified\":%llu,\"id\":%d",
+               index, added, added + rnd(1000000) * 1000ULL, ++b->id);
+}
+
+/* The folders of the root, as guid, title, root */
+const char *roots[][3] = {
+    {"menu________", "menu", "bookmarksMenuFolder"},
+    {"toolbar_____", "toolbar", "toolbarFolder"},
+    {"unfiled_____", "unfiled", "unfiledBookmarksFolder"},
+    {"mobile______", "mobile", "mobileFolder"},
+};
+
+void put_folder(out_t *o, bm_t *b, int level, int count, int index, const char **root)
+{
+    int i;
+    if (root)
+        out_printf(o, "{\"guid\":\"%s\",\"title\":\"%s\",\"index\":%d,\"dateAdded\":%llu,"
+                   "\"lastModified\":%llu,\"id\":%d", root[0], root[1], index, prtime(), prtime(), ++b->id);
+    else
+        put_item_head(o, b, index);
+    out_printf(o, ",\"typeCode\":2,\"type\":\"text/x-moz-place-container\"");
+    if (root)
+        out_printf(o, ",\"root\":\"%s\"", root[2]);
+    out_printf(o, ",\"children\":[");
+    for (i = 0; i < count && b->left > 0; i++) {
+        if (i)
+            out_printf(o, ",");
+        if (level < b->depth && !rnd(8)) {
+            put_folder(o, b, level + 1, 1 + rnd(30), i, 0);
+        } else if (!rnd(40)) {
+            put_item_head(o, b, i);
+            out_printf(o, ",\"typeCode\":3,\"type\":\"text/x-moz-place-separator\"}");
+        } else {
+            const site_t *s = &sites[rnd(NSITES)];
+            put_item_head(o, b, i);
+            out_printf(o, ",\"typeCode\":1,\"type\":\"text/x-moz-place\"");
+            if (s->icon && !rnd(4))
+                out_printf(o, ",\"iconuri\":\"https://%s/favicon.ico\",\"icon\":\"data:image/png;base64,%s\"",
+                           s->host, s->icon);
+            out_printf(o, ",\"uri\":\"");
+            put_url(o, s);
+            out_printf(o, "\"}");
+            b->left--;
+        }
+    }
+    out_printf(o, "]}");
+}
+
+void gen_bookmarks(out_t *o, int count, int depth)
+{
+    bm_t b = {0};
+    int i;
+    b.left = count;
+    b.depth = depth;
+    out_printf(o, "{\"guid\":\"root________\",\"title\":\"\",\"index\":0,\"dateAdded\":%llu,"
+               "\"lastModified\":%llu,\"id\":%d,\"typeCode\":2,\"type\":\"text/x-moz-place-container\","
+               "\"root\":\"placesRoot\",\"children\":[", prtime(), prtime(), ++b.id);
+    for (i = 0; i < 4; i++) {
+        /* most bookmarks go to the menu and unfiled */
+        int n = i == 3 ? count : i == 1 ? count / 10 : count / 2;
+        if (i)
+            out_printf(o, ",");
+        put_folder(o, &b, 0, n, i, roots[i]);
+    }
+    out_printf(o, "]}");
+}
+
+/*
+   Session: windows with tabs, each with its history entries.
+*/
+void put_entry(out_t *o, int id)
+{
+    const site_t *s = &sites[rnd(NSITES)];
+    out_printf(o, "{\"url\":\"");
+    put_url(o, s);
+    out_printf(o, "\",\"title\":\"");
+    put_title(o, 2 + rnd(8));
+    out_printf(o, "\",\"cacheKey\":0,\"ID\":%d,\"docshellUUID\":", id);
+    put_uuid(o);
+    out_printf(o, ",\"referrerInfo\":\"ljNuN5tcRV+bJ1+EHVJdKQAAAAAAAAAAwAAAAAAAAEYAAAAAAAEBAAAAAAEA\","
+               "\"originalURI\":\"https://%s/\",\"resultPrincipalURI\":null,"
+               "\"hasUserInteraction\":%s,\"triggeringPrincipal_base64\":\"{\\\"3\\\":{}}\","
+               "\"docIdentifier\":%d,\"persist\":true}",
+               s->host, rnd(2) ? "true" : "false", id + 100);
+}
+
+void gen_session(out_t *o, int nwindows, int ntabs, int history)
+{
+    int w, t, e, id = 0;
+    out_printf(o, "{\"version\":[\"sessionrestore\",1],\"windows\":[");
+    for (w = 0; w < nwindows; w++) {
+        int n = ntabs / nwindows + (w < ntabs % nwindows);
+        out_printf(o, "%s{\"tabs\":[", w ? "," : "");
+        for (t = 0; t < n; t++) {
+            const site_t *s = &sites[rnd(NSITES)];
+            int nentries = 1 + rnd(history > 0 ? history : 1);
+            out_printf(o, "%s{\"entries\":[", t ? "," : "");
+            for (e = 0; e < nentries; e++) {
+                if (e)
+                    out_printf(o, ",");
+                put_entry(o, ++id);
+            }
+            out_printf(o, "],\"requestedIndex\":0,\"lastAccessed\":%llu,\"hidden\":false,"
+                       "\"searchMode\":null,\"userContextId\":0,\"attributes\":{},\"index\":%d",
+                       prtime() / 1000, nentries);
+            if (s->icon)
+                out_printf(o, ",\"image\":\"data:image/png;base64,%s\"", s->icon);
+            out_printf(o, "}");
+        }
+        out_printf(o, "],\"selected\":%d,\"_closedTabs\":[],\"busy\":false,\"width\":%d,"
+                   "\"height\":%d,\"screenX\":%d,\"screenY\":%d,\"sizemode\":\"normal\","
+                   "\"title\":\"", n ? 1 + rnd(n) : 0, 800 + rnd(1200), 600 + rnd(600), rnd(200), rnd(200));
+        put_title(o, 3);
+        out_printf(o, "\"}");
+    }
+    out_printf(o, "],\"selectedWindow\":1,\"_closedWindows\":[],\"session\":{\"lastUpdate\":%llu,"
+               "\"startTime\":%llu,\"recentCrashes\":0},\"global\":{}}", prtime() / 1000, prtime() / 1000);
+}
+
+int main(int argc, char **argv)
+{
+    int i, compress = 0, session = 0, nbookmarks = 1000, depth = 3;
+    int nwindows = 2, ntabs = 100, history = 5, rv = 1;
+    const char *oname = 0;
+    FILE *ofile = 0;
+    out_t o = {0};
+    char *cdata = 0;
+
+    /* process arguments */
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (!strcmp(argv[i], "-h"))
+            exit_usage(0);
+        else if (!strcmp(argv[i], "-z"))
+            compress = 1;
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            rng_state = strtoull(argv[++i], 0, 10) * 2 + 1;  /* never 0 */
+        else
+            exit_usage(1);
+    }
+    if (i == argc)
+        exit_usage(1);
+    if (!strcmp(argv[i], "session"))
+        session = 1;
+    else if (strcmp(argv[i], "bookmarks"))
+        exit_usage(1);
+    for (i++; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        int *opt = 0;
+        if (!session && !strcmp(argv[i], "-b"))
+            opt = &nbookmarks;
+        else if (!session && !strcmp(argv[i], "-d"))
+            opt = &depth;
+        else if (session && !strcmp(argv[i], "-w"))
+            opt = &nwindows;
+        else if (session && !strcmp(argv[i], "-t"))
+            opt = &ntabs;
+        else if (session && !strcmp(argv[i], "-H"))
+            opt = &history;
+        if (!opt || i + 1 == argc || (*opt = atoi(argv[++i])) < 0)
+            exit_usage(1);
+    }
+    if (argc - i != 1 || (session && nwindows < 1))
+        exit_usage(1);
+    if (strcmp("-", argv[i]))
+        oname = argv[i];
+
+    if (!(ofile = oname ? fopen(oname, "wb") : stdout))
+        ERR_CLEANUP("cannot open '%s' for writing\n", oname);
+    if (!oname && ensure_binary(ofile))
+        fprintf(stderr, "Warning: cannot set stdout to binary mode\n");
+    if (init_sites())
+        ERR_CLEANUP("cannot allocate memory\n");
+
+    o.f = compress ? 0 : ofile;
+    if (session)
+        gen_session(&o, nwindows, ntabs, history);
+    else
+        gen_bookmarks(&o, nbookmarks, depth);
+    out_flush(&o);
+    if (o.failed && o.f)
+        ERR_CLEANUP("cannot write to '%s'\n", oname ? oname : "<stdout>");
+    if (o.failed)
+        ERR_CLEANUP("cannot allocate memory\n");
+
+    if (compress) {
+        /* the same output as jsonlz4 (at level 1) */
+        unsigned char hdr[12];
+        int csize;
+        if (o.len > LZ4_MAX_INPUT_SIZE)
+            ERR_CLEANUP("the output is too large for mozLz40\n");
+        if (!(cdata = malloc(LZ4_compressBound((int)o.len) + 1)))
+            ERR_CLEANUP("cannot allocate memory\n");
+        if (!(csize = LZ4_compress(o.data, cdata, (int)o.len)))
+            ERR_CLEANUP("compression failed\n");
+        memcpy(hdr, mozlz4_magic, 8);
+        for (i = 0; i < 4; i++)
+            hdr[8 + i] = (o.len >> (8 * i)) & 0xff;
+        if (fwrite(hdr, 1, 12, ofile) != 12 || fwrite(cdata, 1, csize, ofile) != (size_t)csize)
+            ERR_CLEANUP("cannot write to '%s'\n", oname ? oname : "<stdout>");
+    }
+    if (fflush(ofile))
+        ERR_CLEANUP("cannot write to '%s'\n", oname ? oname : "<stdout>");
+    rv = 0;
+
+cleanup:
+    if (ofile && oname)
+        fclose(ofile);
+    for (i = 0; i < NSITES; i++)
+        free(sites[i].icon);
+    free(cdata);
+    free(o.data);
+    return rv;
+}
@@ -31,31 +31,92 @@
 */
 
 /*
-   lz4.c and lz4.h are verbatim copies from Mozilla source tree mfbt/lz4.*
-   (Mercurial) rev: c3f5e6079284 (2016-05-12) and carry their own license.
+   lz4.c and lz4.h are based on copies from Mozilla source tree mfbt/lz4.*
+   (Mercurial) rev: c3f5e6079284 (2016-05-12), with local performance changes,
+   and carry their own license.
 */
 
-/* Build: gcc -Wall -o dejsonlz4 dejsonlz4.c lz4.c */
+/* Build: gcc -Wall -pthread -o dejsonlz4 dejsonlz4.c mozlz4.c json.c lz4.c */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  include <unistd.h>
+#  define HAVE_MMAP 1
+#  define MKDIR(path) mkdir(path, 0777)
+#else
+#  include <direct.h>
+#  define MKDIR(path) _mkdir(path)
+#endif
 
 #include "lz4.h"
+#include "mozlz4.h"
+#include "json.h"
 
-const char mozlz4_magic[] = {109, 111, 122, 76, 122, 52, 48, 0};  /* "mozLz40\0" */
-const int decomp_size = 4;  /* 4 bytes size come after the header */
 
 void exit_usage(int code) {
     fprintf((code ? stderr : stdout), "%s",
-            "Usage: dejsonlz4 [-h] IN_FILE [OUT_FILE]\n"
+            "Usage: dejsonlz4 [-h] [-s] [--head BYTES] [JSON_OUTPUT] [-p N] IN_FILE [OUT_FILE]\n"
+            "       dejsonlz4 [-s] [JSON_OUTPUT] -j N [--files-from LIST] FILE...\n"
+            "       dejsonlz4 [-s] [JSON_OUTPUT] [-j N] [-o OUT_DIR] -r DIR\n"
+            "       dejsonlz4 --info [--json] [-j N] [--files-from LIST] [-r DIR] [FILE...]\n"
+            "       dejsonlz4 --build-index IN_FILE\n"
+            "       dejsonlz4 --range OFF:LEN IN_FILE [OUT_FILE]\n"
+            "       dejsonlz4 --url-index INDEX [-j N] [--files-from LIST] [-r DIR] [FILE...]\n"
+            "       dejsonlz4 --url-lookup INDEX URL\n"
+            "       dejsonlz4 --grep PATTERN [-l] [-j N] [--files-from LIST] [-r DIR] [FILE...]\n"
             "   -h  Display this help and exit.\n"
+            "   -s  Stream: decompress with bounded memory, write output as it's produced.\n"
+            "   --head BYTES  Decompress only the first BYTES bytes (implies -s).\n"
+            "   JSON_OUTPUT is one of (and implies -s):\n"
+            "   --pretty  Write the JSON indented, one value per line.\n"
+            "   --minify  Write the JSON without whitespace.\n"
+            "   --select PATH [--raw]  Write only the values at PATH, one per line,\n"
+            "         e.g. '.children[].children[].uri' (a subset of jq paths: .key,\n"
+            "         .\"key\", [] and [N]). With --raw, strings are written unquoted.\n"
+            "         As in jq, a missing key or element gives null.\n"
+            "   --export FORMAT  Write a line per bookmark: its folders path, title,\n"
+            "         uri, dateAdded, lastModified and tags, as tsv, csv or ndjson,\n"
+            "         or only its uri (with uri).\n"
+            "   -p N  Parallel: decompress IN_FILE using N threads (if it's 1M or more).\n"
+            "   -j N  Batch: decompress each FILE (and each file listed in LIST, one per\n"
+            "         line, '-' is stdin) using N threads. X.jsonlz4 is written to X.json,\n"
+            "         X.mozlz4 to X, and other names get '.json' appended.\n"
+            "   -r DIR  Decompress all the mozLz40 files under DIR (detected by their\n"
+            "           header), using N threads (default 1). Output file names are as\n"
+            "           with -j, next to the inputs, or in a mirrored tree at OUT_DIR.\n"
+            "   --info  Only read the headers, and print the decompressed size, the\n"
+            "           file size and their ratio for each file.\n"
+            "   --json  With --info, print one JSON object per line instead.\n"
+            "   --build-index  Write an index of checkpoints (every 1M of output) of\n"
+            "                  IN_FILE to IN_FILE.idx, for --range.\n"
+            "   --range OFF:LEN  Decompress only LEN bytes from offset OFF, starting at\n"
+            "                    the checkpoint before OFF in IN_FILE.idx (if it exists).\n"
+            "   --url-index  Update INDEX (or create it) with the URLs of the bookmarks in\n"
+            "                the given backups, decompressing only the new or changed\n"
+            "                ones. Backups which aren't given are removed from it.\n"
+            "   --url-lookup  Print the first and last backups in INDEX which have URL,\n"
+            "                 and their number.\n"
+            "   --grep  Print FILE:OFFSET for each PATTERN (a string) in the decompressed\n"
+            "           files (or their first BYTES with --head), or with -l, only the\n"
+            "           names of the files which have it. Exits with 1 if none has it.\n"
             "Decompress Mozilla bookmarks backup file IN_FILE to OUT_FILE.\n"
             "If IN_FILE is '-', decompress from standard input.\n"
             "If OUT_FILE is '-' or missing, decompress to standard output.\n"
-            "Note: IN_FILE is transferred to memory entirely before decompressing.\n"
-            "Decompression is also done in memory entirely before output.\n"
+            "Note: IN_FILE is mapped or transferred to memory entirely before decompressing.\n"
+            "Decompression is done directly into a mapped OUT_FILE if possible,\n"
+            "and standard output is written as it's decompressed (except with -p),\n"
+            "otherwise in memory entirely before output.\n"
            );
     exit(code);
 }
@@ -73,93 +134,2304 @@ int ensure_binary(FILE *f)
 
 #define INITIAL_ALLOC_SIZE (32 * 1024)
 
-/* if fname is NULL, reads from stdin till EOF */
-void *file_to_mem(const char *fname, size_t *out_size)
+/* Returns the size of f if it's a regular file, or 0 if unknown */
+size_t known_size(FILE *f)
 {
-    unsigned char *buf = 0, *rv = 0;
-    size_t buf_size = 0, got = 0;
+    struct stat st;
+#ifdef _WIN32
+    if (fstat(_fileno(f), &st))
+#else
+    if (fstat(fileno(f), &st))
+#endif
+        return 0;
+    if ((st.st_mode & S_IFMT) != S_IFREG || st.st_size <= 0
+        || (unsigned long long)st.st_size >= (size_t)-1)
+        return 0;
+    return st.st_size;
+}
+
+/* A growable buffer, reused across files */
+typedef struct {
+    char *data;
+    size_t size;  /* allocated size */
+} buf_t;
+
+/* Grows b to at least size bytes (keeping its content). Returns non-zero on OOM */
+int buf_reserve(buf_t *b, size_t size)
+{
+    char *p;
+    if (size <= b->size)
+        return 0;
+    if (!(p = realloc(b->data, size)))
+        return 1;
+    b->data = p;
+    b->size = size;
+    return 0;
+}
+
+/* Reads fname till EOF into b, growing it as needed. If fname is NULL, reads
+ * from stdin. Returns non-zero on failure */
+int file_to_mem(const char *fname, buf_t *b, size_t *out_size)
+{
+    size_t want, got = 0;
+    int rv = 1;
     FILE *f = fname ? fopen(fname, "rb") : stdin;
     if (!f)
-        return 0;  /* can't do anything */
+        return 1;  /* can't do anything */
     if (!fname && ensure_binary(f))
         fprintf(stderr, "Warning: cannot set stdin to binary mode\n");
 
-    do {
-        buf_size = got ? got * 2 : INITIAL_ALLOC_SIZE;
-        if (buf_size <= got || !(buf = realloc(buf, buf_size)))
-            break;  /* size_t wrap-around or OOM: break before EOF */
-        rv = buf;
-        got += fread(buf + got, 1, buf_size - got, f);
-    } while (got == buf_size);  /* otherwise feof(f) or ferror(f) */
+    /* if the size is known, one extra byte lets the first fread hit EOF */
+    want = known_size(f);
+    want = want ? want + 1 : INITIAL_ALLOC_SIZE;
 
-    if (!buf || !feof(f) || ferror(f)) {
-        if (rv)
-            free(rv);
-        rv = 0;
+    for (;;) {
+        if (want <= got || buf_reserve(b, want))
+            break;  /* size_t wrap-around or OOM: break before EOF */
+        got += fread(b->data + got, 1, b->size - got, f);
+        if (got < b->size) {  /* feof(f) or ferror(f) */
+            rv = !feof(f) || ferror(f);
+            break;
+        }
+        want = got * 2;
     }
 
-    if (f && fname)
+    if (fname)
         fclose(f);
-    if (rv && out_size)
+    if (!rv && out_size)
         *out_size = got;
     return rv;
 }
 
-const size_t magic_size = sizeof mozlz4_magic;
+/* Maps the regular file fname read-only. Returns 0 if it can't be mapped (e.g.
+ * not a regular file, empty, or no mmap support), and then file_to_mem should
+ * be used instead. Release the mapping with unmap_file. */
+void *map_file(const char *fname, size_t *out_size)
+{
+#ifdef HAVE_MMAP
+    struct stat st;
+    void *p;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0
+        || (unsigned long long)st.st_size > (size_t)-1)
+    {
+        close(fd);
+        return 0;
+    }
+
+    p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  /* the mapping stays valid */
+    if (p == MAP_FAILED)
+        return 0;
+#ifdef MADV_SEQUENTIAL
+    madvise(p, st.st_size, MADV_SEQUENTIAL);  /* only a hint, ignore failure */
+#endif
+    *out_size = st.st_size;
+    return p;
+#else
+    (void)fname; (void)out_size;
+    return 0;
+#endif
+}
+
+void unmap_file(void *p, size_t size)
+{
+#ifdef HAVE_MMAP
+    munmap(p, size);
+#endif
+}
+
+/* Creates a new temporary file next to oname, of size bytes, and maps it
+ * writable, so that decompression writes directly to a file which then
+ * replaces oname. oname itself isn't modified. Returns 0 if it can't be mapped,
+ * or if oname is the input file iname or not a regular file, or if replacing it
+ * would lose something: it's a symlink or has other hard links (which should
+ * see the new content), or its owner or group can't be kept. On success,
+ * *out_fd and *out_tmp (the temporary name, to free) should be passed to
+ * unmap_output. */
+void *map_output(const char *oname, const char *iname, size_t size, int *out_fd, char **out_tmp)
+{
+#ifdef HAVE_MMAP
+    struct stat ist, ost, tst;
+    char *tmp;
+    void *p;
+    int fd = -1, i, exists;
+    if (!size || (unsigned long long)size > (unsigned long long)((off_t)-1 >> 1))
+        return 0;
+    exists = !lstat(oname, &ost);
+    if (exists && (!S_ISREG(ost.st_mode) || ost.st_nlink > 1
+        || (iname && !stat(iname, &ist) && ist.st_dev == ost.st_dev && ist.st_ino == ost.st_ino)))
+        return 0;
+    if (!(tmp = malloc(strlen(oname) + 32)))
+        return 0;
+
+    /* like mkstemp, but with the permissions of a new file (umask) */
+    for (i = 0; i < 100 && fd < 0; i++) {
+        sprintf(tmp, "%s.%ld-%d.tmp", oname, (long)getpid(), i);
+        if ((fd = open(tmp, O_RDWR | O_CREAT | O_EXCL, 0666)) < 0 && errno != EEXIST)
+            break;
+    }
+    if (fd < 0) {
+        free(tmp);
+        return 0;
+    }
+
+    /* keep the owner, group and permissions of oname (the owner first, since
+     * changing it may clear the setuid/setgid bits) */
+    if ((exists && (fstat(fd, &tst)
+                    || ((tst.st_uid != ost.st_uid || tst.st_gid != ost.st_gid)
+                        && fchown(fd, ost.st_uid, ost.st_gid))
+                    || fchmod(fd, ost.st_mode & 07777)))
+#ifdef __linux__
+        /* reserve the blocks now, or a full disk would SIGBUS while decompressing */
+        || posix_fallocate(fd, 0, size)
+#else
+        || ftruncate(fd, size)
+#endif
+        || (p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return 0;
+    }
+    *out_fd = fd;
+    *out_tmp = tmp;
+    return p;
+#else
+    (void)oname; (void)iname; (void)size; (void)out_fd; (void)out_tmp;
+    return 0;
+#endif
+}
+
+/* Unmaps output from map_output, and renames its temporary file tmp to oname,
+ * or if oname is NULL, removes it. Frees tmp. Returns non-zero on failure */
+int unmap_output(void *p, size_t size, int fd, char *tmp, const char *oname)
+{
+#ifdef HAVE_MMAP
+    int err = munmap(p, size);
+    err |= close(fd);
+    if (!oname || err || rename(tmp, oname)) {
+        unlink(tmp);
+        err = 1;
+    }
+    free(tmp);
+    return err;
+#else
+    (void)p; (void)size; (void)fd; (void)tmp; (void)oname;
+    return 1;
+#endif
+}
 
 #define ERR_CLEANUP(...) { fprintf(stderr, "Error: " __VA_ARGS__); goto cleanup; }
 
-int main(int argc, char **argv)
+/* Returns non-zero if both names refer to the same existing file */
+int same_file(const char *a, const char *b)
+{
+#ifndef _WIN32
+    struct stat sa, sb;
+    return !stat(a, &sa) && !stat(b, &sb) && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#else
+    (void)a; (void)b;
+    return 0;  /* st_ino is not meaningful on Windows */
+#endif
+}
+
+/* mozlz4_stream_t callbacks for FILE* */
+long read_file(void *f, void *buf, size_t size)
+{
+    size_t n = fread(buf, 1, size, f);
+    return n || !ferror((FILE *)f) ? (long)n : -1;
+}
+
+int write_file(void *f, const void *buf, size_t size)
+{
+    return fwrite(buf, 1, size, f) != size || fflush(f);
+}
+
+/* and for memory */
+typedef struct {
+    const char *data;
+    size_t len;
+} mem_t;
+
+long read_mem(void *mem, void *buf, size_t size)
+{
+    mem_t *m = mem;
+    if (size > m->len)
+        size = m->len;
+    if (size > LONG_MAX)
+        size = LONG_MAX;
+    memcpy(buf, m->data, size);
+    m->data += size;
+    m->len -= size;
+    return (long)size;
+}
+
+/* Returns non-zero if path is valid for --select */
+int valid_path(const char *path)
+{
+    json_sel_t *s = malloc(sizeof *s);
+    int rv = s && !json_sel_init(s, path, 0, 0, 0);
+    free(s);
+    return rv;
+}
+
+/* Options of stream_file */
+typedef struct {
+    size_t stop;         /* decompress only this many bytes */
+    int format;          /* 0 or a JSON_* mode */
+    const char *select;  /* if not NULL, write only the values at this path */
+    int raw;             /* of the selected strings */
+    int export;          /* 0 or a JSON_EXPORT_* format */
+    const char *grep;    /* for grep_file: the pattern */
+    int files_only;      /* and print only the names of the files which have it */
+} stream_opts_t;
+
+/* Decompresses iname to oname (stdin/stdout if NULL) using a stream, with the
+ * options o. Returns 0 on success */
+int stream_file(const char *iname, const char *oname, const stream_opts_t *o)
+{
+    const char *dname = iname ? iname : "<stdin>";
+    FILE *ifile = 0, *ofile = 0;
+    mozlz4_stream_t *s = 0;
+    json_fmt_t *fmt = 0;
+    json_sel_t *sel = 0;
+    json_exp_t *exp = 0;
+    int rv = 1, err;
+
+    if (!(s = malloc(sizeof *s)) || (o->format && !(fmt = malloc(sizeof *fmt)))
+        || (o->select && !(sel = malloc(sizeof *sel)))
+        || (o->export && !(exp = calloc(1, sizeof *exp))))  /* zeroed, for json_exp_free */
+        ERR_CLEANUP("cannot allocate memory\n");
+    if (!(ifile = iname ? fopen(iname, "rb") : stdin))
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (!iname && ensure_binary(ifile))
+        fprintf(stderr, "Warning: cannot set stdin to binary mode\n");
+
+    mozlz4_stream_init(s, read_file, ifile, write_file, 0);
+    if ((err = mozlz4_stream_header(s)) == MOZLZ4_ERR_READ)
+        ERR_CLEANUP("cannot read file '%s'\n", dname);
+    if (err)
+        ERR_CLEANUP("'%s': unsupported file format\n", dname);
+
+    if (iname && oname && same_file(iname, oname))
+        ERR_CLEANUP("cannot stream into the input file '%s'\n", oname);
+    if (!(ofile = oname ? fopen(oname, "wb") : stdout))
+        ERR_CLEANUP("cannot open '%s' for writing\n", oname);
+    if (!oname && ensure_binary(ofile))
+        fprintf(stderr, "Warning: cannot set stdout to binary mode\n");
+
+    s->write_opaque = ofile;
+    if (fmt) {
+        json_fmt_init(fmt, o->format, write_file, ofile);
+        s->write = json_fmt_write;
+        s->write_opaque = fmt;
+    }
+    if (sel) {
+        if (json_sel_init(sel, o->select, o->raw, write_file, ofile))
+            ERR_CLEANUP("invalid path '%s'\n", o->select);
+        s->write = json_sel_write;
+        s->write_opaque = sel;
+    }
+    if (exp) {
+        json_exp_init(exp, o->export, write_file, ofile);
+        s->write = json_exp_write;
+        s->write_opaque = exp;
+    }
+    err = mozlz4_stream_decode(s, o->stop);
+    if (!err && ((fmt && json_fmt_end(fmt)) || (sel && json_sel_end(sel))
+                 || (exp && json_exp_end(exp))))
+        err = MOZLZ4_ERR_WRITE;
+    if (exp && exp->nomem)
+        ERR_CLEANUP("cannot allocate memory\n");
+    if ((sel && sel->bad) || (exp && exp->bad))
+        ERR_CLEANUP("'%s': the decompressed data isn't JSON\n", dname);
+    if (err == MOZLZ4_ERR_FORMAT)
+        ERR_CLEANUP("'%s': decompression failed: malformed data\n", dname);
+    if (err == MOZLZ4_ERR_READ)
+        ERR_CLEANUP("cannot read file '%s'\n", dname);
+    if (err == MOZLZ4_ERR_WRITE)
+        ERR_CLEANUP("cannot write to '%s'\n", oname ? oname : "<stdout>");
+    if (s->total != s->size && s->total != o->stop)
+        fprintf(stderr, "Warning: '%s': decompressed file smaller than expected\n", dname);
+
+    rv = 0;
+
+cleanup:
+    if (ofile && oname)
+        fclose(ofile);
+    if (ifile && iname)
+        fclose(ifile);
+    if (exp) {
+        json_exp_free(exp);
+        free(exp);
+    }
+    if (sel)
+        free(sel);
+    if (fmt)
+        free(fmt);
+    if (s)
+        free(s);
+    return rv;
+}
+
+/*
+   Parallel decoding of one file (-p N): the block is divided by input offset
+   into chunks which start where mozlz4_sync finds, and worker threads decode
+   them speculatively. A chunk is real if the real chunk before it ended
+   exactly at its start, which also places it in the output. Otherwise, the
+   chunk before it continued over it. A real chunk first resolves its last 64K,
+   which is the window of the next chunk, and then the rest.
+*/
+#define PAR_MIN_SIZE   (1024 * 1024)  /* decompressed. Smaller files use one thread */
+#define PAR_MIN_CHUNK  (256 * 1024)   /* compressed */
+#define PAR_CHUNKS     4              /* per thread */
+
+#define CHUNK_UNKNOWN  0
+#define CHUNK_REAL     1
+#define CHUNK_BOGUS    2
+
+typedef struct {
+    size_t start;   /* in the block */
+    size_t opos;    /* once it's real */
+    int state;      /* CHUNK_* */
+    int prev;       /* the real chunk before it, or -1 */
+    int tail_done;  /* its last 64K output is final */
+} par_chunk_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;  /* a chunk state or tail_done changed, or failed */
+    const char *src;
+    size_t srclen, blen;  /* blen is the block size */
+    char *dst;
+    size_t size;
+    par_chunk_t *chunks;
+    int nchunks;
+    int next;      /* the next chunk to decode */
+    size_t total;  /* the output size, once the last chunk is real */
+    int failed;
+} par_t;
+
+/* Decodes from c till it ends at the start of chunk *next, or of a later chunk
+ * (then updates *next), or at the end of the block (then *next is nchunks).
+ * *sym is reallocated as needed. Returns a MOZLZ4_* value */
+int par_decode(par_t *p, mozlz4_chunk_t *c, int *next, unsigned short **sym, size_t *cap)
+{
+    for (;;) {
+        size_t stop = *next < p->nchunks ? p->chunks[*next].start : p->blen;
+        int err = mozlz4_decode_chunk(p->src, p->srclen, c, stop, *sym, *cap);
+        if (err == MOZLZ4_ERR_SIZE) {
+            unsigned short *tmp = realloc(*sym, 2 * *cap * sizeof **sym);
+            if (!tmp)
+                return err;
+            *sym = tmp;
+            *cap *= 2;
+            continue;
+        }
+        if (err)
+            return err;
+        if (c->ipos == p->blen)
+            *next = p->nchunks;
+        else if (c->ipos > stop) {
+            (*next)++;  /* that chunk's start is not a sequence start */
+            continue;
+        }
+        return MOZLZ4_OK;
+    }
+}
+
+/* Sets failed and wakes up everyone. Called with the lock held */
+void par_fail(par_t *p)
+{
+    p->failed = 1;
+    pthread_cond_broadcast(&p->cond);
+}
+
+/* Decodes chunk k, and if it's real, writes it to the output */
+void par_chunk(par_t *p, int k)
+{
+    par_chunk_t *ch = &p->chunks[k];
+    size_t ilen = (k + 1 < p->nchunks ? p->chunks[k + 1].start : p->blen) - ch->start;
+    size_t cap = ilen * (p->size / p->blen + 1) + MOZLZ4_STREAM_WINDOW;
+    unsigned short *sym = malloc(cap * sizeof *sym);
+    mozlz4_chunk_t c = {0};
+    size_t opos, tail;
+    int next = k + 1, i, err;
+
+    c.ipos = ch->start;
+    err = sym ? par_decode(p, &c, &next, &sym, &cap) : MOZLZ4_ERR_SIZE;
+
+    pthread_mutex_lock(&p->lock);
+    while (ch->state == CHUNK_UNKNOWN && !p->failed)
+        pthread_cond_wait(&p->cond, &p->lock);
+    if (ch->state != CHUNK_REAL || p->failed)
+        goto done;
+    opos = ch->opos;
+
+    if (err == MOZLZ4_ERR_WINDOW) {
+        /* decode it again, reading the window once it's final */
+        while (ch->prev >= 0 && !p->chunks[ch->prev].tail_done && !p->failed)
+            pthread_cond_wait(&p->cond, &p->lock);
+        if (p->failed)
+            goto done;
+        pthread_mutex_unlock(&p->lock);
+        memset(&c, 0, sizeof c);
+        c.ipos = ch->start;
+        c.window = (unsigned char *)p->dst + opos;
+        c.window_len = opos < MOZLZ4_STREAM_WINDOW ? opos : MOZLZ4_STREAM_WINDOW;
+        next = k + 1;
+        err = par_decode(p, &c, &next, &sym, &cap);
+        pthread_mutex_lock(&p->lock);
+    }
+    if (err || c.need > p->size - opos) {
+        par_fail(p);
+        goto done;
+    }
+
+    /* it ended at the start of next, which is real, and the ones before are bogus */
+    for (i = k + 1; i < next; i++)
+        p->chunks[i].state = CHUNK_BOGUS;
+    if (next < p->nchunks) {
+        p->chunks[next].state = CHUNK_REAL;
+        p->chunks[next].opos = opos + c.olen;
+        p->chunks[next].prev = k;
+    } else {
+        p->total = opos + c.olen;
+    }
+    pthread_cond_broadcast(&p->cond);
+
+    /* resolve the tail once the window is final, and then the rest */
+    while (ch->prev >= 0 && !p->chunks[ch->prev].tail_done && !p->failed)
+        pthread_cond_wait(&p->cond, &p->lock);
+    if (p->failed)
+        goto done;
+    pthread_mutex_unlock(&p->lock);
+
+    tail = c.olen < MOZLZ4_STREAM_WINDOW ? c.olen : MOZLZ4_STREAM_WINDOW;
+    err = mozlz4_chunk_resolve(p->dst, opos, &c, sym, c.olen - tail, tail);
+
+    pthread_mutex_lock(&p->lock);
+    if (err) {
+        par_fail(p);
+        goto done;
+    }
+    ch->tail_done = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+
+    mozlz4_chunk_resolve(p->dst, opos, &c, sym, 0, c.olen - tail);  /* same checks as the tail */
+    free(sym);
+    return;
+
+done:
+    pthread_mutex_unlock(&p->lock);
+    free(sym);
+}
+
+/* Thread function: decode chunks till they're all taken */
+void *par_worker(void *arg)
+{
+    par_t *p = arg;
+    for (;;) {
+        int k;
+        pthread_mutex_lock(&p->lock);
+        while (p->next < p->nchunks && p->chunks[p->next].state == CHUNK_BOGUS)
+            p->next++;  /* already known, skip it */
+        k = p->failed ? p->nchunks : p->next++;
+        pthread_mutex_unlock(&p->lock);
+        if (k >= p->nchunks)
+            break;
+        par_chunk(p, k);
+    }
+    return 0;
+}
+
+/* Like mozlz4_decode_into, using nthreads threads if it's large enough */
+int decode_parallel(const char *src, size_t srclen, char *dst, size_t size, int nthreads, size_t *dsize)
+{
+    par_t p;
+    pthread_t *threads = 0;
+    size_t step, pos, start;
+    int i, started = 0;
+
+    if (nthreads < 2 || size < PAR_MIN_SIZE || srclen <= MOZLZ4_HEADER_SIZE)
+        return mozlz4_decode_into(src, srclen, dst, size, dsize);
+
+    memset(&p, 0, sizeof p);
+    pthread_mutex_init(&p.lock, 0);
+    pthread_cond_init(&p.cond, 0);
+    p.src = src;
+    p.srclen = srclen;
+    p.blen = srclen - MOZLZ4_HEADER_SIZE;
+    p.dst = dst;
+    p.size = size;
+    step = p.blen / ((size_t)nthreads * PAR_CHUNKS);
+    if (step < PAR_MIN_CHUNK)
+        step = PAR_MIN_CHUNK;
+
+    /* the first chunk starts the block, and the others where they're found */
+    p.chunks = calloc(p.blen / step + 1, sizeof *p.chunks);
+    threads = calloc(nthreads, sizeof *threads);
+    if (!p.chunks || !threads)
+        goto single;
+    p.chunks[0].state = CHUNK_REAL;
+    p.chunks[0].prev = -1;
+    p.nchunks = 1;
+    for (pos = step; pos < p.blen; pos += step) {
+        if (!mozlz4_sync(src, srclen, pos, pos + step, &start) && start > p.chunks[p.nchunks - 1].start)
+            p.chunks[p.nchunks++].start = start;
+    }
+    if (p.nchunks < 2)
+        goto single;
+
+    for (; started < nthreads; started++) {
+        if (pthread_create(&threads[started], 0, par_worker, &p))
+            break;
+    }
+    if (!started)
+        goto single;
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], 0);
+
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+    free(p.chunks);
+    free(threads);
+    if (p.failed)
+        return MOZLZ4_ERR_FORMAT;
+    *dsize = p.total;
+    return MOZLZ4_OK;
+
+single:
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+    free(p.chunks);
+    free(threads);
+    return mozlz4_decode_into(src, srclen, dst, size, dsize);
+}
+
+/* Decompresses the mozLz40 data of len bytes to stdout, in chunks. Returns 0
+ * on success */
+int decompress_stdout(const char *data, size_t len, const char *dname)
 {
-    size_t isize = 0, osize = 0;
-    const char *iname = 0, *oname = 0;
-    char *idata = 0, *odata = 0;
+    mozlz4_stream_t *s = malloc(sizeof *s);
+    mem_t m;
+    int rv = 1, err;
+
+    m.data = data;
+    m.len = len;
+    if (!s)
+        ERR_CLEANUP("cannot allocate memory for output\n");
+    if (ensure_binary(stdout))
+        fprintf(stderr, "Warning: cannot set stdout to binary mode\n");
+    mozlz4_stream_init(s, read_mem, &m, write_file, stdout);
+    if ((err = mozlz4_stream_header(s)) || (err = mozlz4_stream_decode(s, (size_t)-1)) == MOZLZ4_ERR_FORMAT)
+        ERR_CLEANUP("'%s': decompression failed: malformed data\n", dname);
+    if (err)
+        ERR_CLEANUP("cannot write to '<stdout>'\n");
+    if (s->total != s->size)
+        fprintf(stderr, "Warning: '%s': decompressed file smaller than expected\n", dname);
+
+    rv = 0;
+
+cleanup:
+    free(s);
+    return rv;
+}
+
+/* Decompresses iname to oname (stdin/stdout if NULL) in memory, using nthreads
+ * threads if it's large enough. The buffers ib and ob are used if needed, and
+ * can be reused. Returns 0 on success */
+int decompress_file(const char *iname, const char *oname, buf_t *ib, buf_t *ob, int nthreads)
+{
+    size_t isize = 0, osize = 0, dsize = 0;
+    const char *dname = iname ? iname : "<stdin>";
+    char *idata = 0, *odata = 0, *otmp = 0;
     FILE *ofile = 0;
-    int rv = 1, i, dsize;
+    int rv = 1, imapped = 0, omapped = 0, ofd = -1;
 
-    /* process arguments */
-    if ((argc > 3) || (argc < 2) || (argc > 1 && !strcmp(argv[1], "-h")))
-        exit_usage(argc == 2 ? 0 : 1);
-    if (argc > 1 && strcmp("-", argv[1]))
-        iname = argv[1];
-    if (argc > 2 && strcmp("-", argv[2]))
-        oname = argv[2];
-
-    /* read input file and validate magic header and minimum size */
-    if (!(idata = file_to_mem(iname, &isize)))
-        ERR_CLEANUP("cannot read file '%s'\n", iname ? iname : "<stdin>");
-    if (isize < magic_size + decomp_size || memcmp(mozlz4_magic, idata, magic_size))
-        ERR_CLEANUP("unsupported file format\n");
-
-    /* read output size and allocate buffer */
-    for (i = magic_size; i < magic_size + decomp_size; i++)
-        osize += (unsigned char)idata[i] << (8 * (i - magic_size));
-    if (!(odata = malloc(osize)))
+    /* map or read input file and validate magic header and minimum size */
+    if (iname && (idata = map_file(iname, &isize)))
+        imapped = 1;
+    else if (!file_to_mem(iname, ib, &isize))
+        idata = ib->data;
+    else
+        ERR_CLEANUP("cannot read file '%s'\n", dname);
+    if (mozlz4_peek_size(idata, isize, &osize))
+        ERR_CLEANUP("'%s': unsupported file format\n", dname);
+
+    /* stdout is written in chunks as they're decoded, so that a reader of a
+     * pipe can start early. Parallel decoding still writes it at the end */
+    if (!oname && (nthreads < 2 || osize < PAR_MIN_SIZE)) {
+        rv = decompress_stdout(idata, isize, dname);
+        goto cleanup;
+    }
+
+    /* map the output file or use the buffer. LZ4 expands at most 255:1, so a
+     * larger size is bogus, and isn't worth the disk space */
+    if (oname && osize / 255 <= isize && (odata = map_output(oname, iname, osize, &ofd, &otmp)))
+        omapped = 1;
+    else if (!buf_reserve(ob, osize ? osize : 1))
+        odata = ob->data;
+    else
         ERR_CLEANUP("cannot allocate memory for output\n");
 
     /* decompress */
-    if ((dsize = LZ4_decompress_safe(idata + i, odata, isize - i, osize)) < 0)
-        ERR_CLEANUP("decompression failed: %d\n", dsize);
+    if (decode_parallel(idata, isize, odata, osize, nthreads, &dsize))
+        ERR_CLEANUP("'%s': decompression failed: malformed data\n", dname);
     if (dsize != osize)
-        fprintf(stderr, "Warning: decompressed file smaller than expected\n");
+        fprintf(stderr, "Warning: '%s': decompressed file smaller than expected\n", dname);
+
+    /* write output: the mapped file replaces oname only if it's whole */
+    if (omapped && dsize == osize) {
+        omapped = 0;  /* unmapped either way */
+        if (unmap_output(odata, osize, ofd, otmp, oname))
+            ERR_CLEANUP("cannot write to '%s'\n", oname);
+    } else {
+        if (!(ofile = oname ? fopen(oname, "wb") : stdout))
+            ERR_CLEANUP("cannot open '%s' for writing\n", oname);
+        if (!oname && ensure_binary(ofile))
+            fprintf(stderr, "Warning: cannot set stdout to binary mode\n");
+        if (dsize != fwrite(odata, 1, dsize, ofile))
+            ERR_CLEANUP("cannot write to '%s'\n", oname ? oname : "<stdout>");
+    }
+
+    rv = 0;
+
+cleanup:
+    if (ofile && oname && fclose(ofile) && !rv) {
+        fprintf(stderr, "Error: cannot write to '%s'\n", oname);
+        rv = 1;
+    }
+    if (omapped)
+        unmap_output(odata, osize, ofd, otmp, 0);  /* failed or partial: remove it */
+    if (imapped)
+        unmap_file(idata, isize);
+
+    return rv;
+}
+
+/*
+   Index (--build-index, --range): checkpoints at the first sequence start in
+   each INDEX_INTERVAL bytes of output, so that a range is decompressed from the
+   checkpoint before it. The index of X is X.idx:
+   - INDEX_MAGIC (8 bytes), the size of X and its decompressed size (to notice
+     a stale index), and the number of checkpoints.
+   - For each checkpoint: its offset in the block, its output offset, and the
+     compressed size of its window.
+   - The windows (the output before each checkpoint, up to 64K), each LZ4
+     compressed on its own.
+   All the numbers are 4 bytes little endian.
+*/
+#define INDEX_MAGIC       "mozLz4i"  /* sizeof is 8, with the terminating \0 */
+#define INDEX_HEADER_SIZE 20
+#define INDEX_ENTRY_SIZE  12
+#define INDEX_INTERVAL    (1024 * 1024)
+
+void put32(unsigned char *p, size_t v)
+{
+    int i;
+    for (i = 0; i < 4; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+size_t get32(const unsigned char *p)
+{
+    return p[0] | (size_t)p[1] << 8 | (size_t)p[2] << 16 | (size_t)p[3] << 24;
+}
+
+/* Returns iname with ".idx" appended (to free), or NULL on OOM */
+char *index_name(const char *iname)
+{
+    char *name = malloc(strlen(iname) + 5);
+    if (name)
+        strcat(strcpy(name, iname), ".idx");
+    return name;
+}
+
+/* Decompresses iname in memory and writes its index to iname.idx. The buffers
+ * ib and ob are used if needed. Returns 0 on success */
+int build_index(const char *iname, buf_t *ib, buf_t *ob)
+{
+    size_t isize = 0, osize = 0, dsize = 0, ipos = 0, opos = 0, n = 0, max, wsize = 0, i;
+    char *idata = 0, *iname_idx = 0;
+    unsigned char *hdr = 0, *windows = 0;
+    FILE *f = 0;
+    int rv = 1, imapped = 0;
+
+    if ((idata = map_file(iname, &isize)))
+        imapped = 1;
+    else if (!file_to_mem(iname, ib, &isize))
+        idata = ib->data;
+    else
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (mozlz4_peek_size(idata, isize, &osize) || isize > 0xffffffff)
+        ERR_CLEANUP("'%s': unsupported file format\n", iname);
+    if (buf_reserve(ob, osize ? osize : 1))
+        ERR_CLEANUP("cannot allocate memory for output\n");
+    if (mozlz4_decode_into(idata, isize, ob->data, osize, &dsize))
+        ERR_CLEANUP("'%s': decompression failed: malformed data\n", iname);
+    if (dsize != osize)
+        ERR_CLEANUP("'%s': decompressed file smaller than expected\n", iname);
+
+    /* at most one checkpoint per interval, and each window compresses alone */
+    max = osize / INDEX_INTERVAL + 1;
+    hdr = malloc(INDEX_HEADER_SIZE + max * INDEX_ENTRY_SIZE);
+    windows = malloc(max * LZ4_compressBound(MOZLZ4_STREAM_WINDOW));
+    if (!hdr || !windows || !(iname_idx = index_name(iname)))
+        ERR_CLEANUP("cannot allocate memory\n");
+
+    while (n < max && opos < osize) {
+        unsigned char *e = hdr + INDEX_HEADER_SIZE + n++ * INDEX_ENTRY_SIZE;
+        size_t wlen = opos < MOZLZ4_STREAM_WINDOW ? opos : MOZLZ4_STREAM_WINDOW;
+        int w = wlen ? LZ4_compress(ob->data + opos - wlen, (char *)windows + wsize, (int)wlen) : 0;
+        put32(e, ipos);
+        put32(e + 4, opos);
+        put32(e + 8, w);
+        wsize += w;
+        if (mozlz4_skip(idata, isize, &ipos, &opos, (opos / INDEX_INTERVAL + 1) * INDEX_INTERVAL))
+            ERR_CLEANUP("'%s': decompression failed: malformed data\n", iname);
+    }
+    memcpy(hdr, INDEX_MAGIC, sizeof INDEX_MAGIC);
+    put32(hdr + 8, isize);
+    put32(hdr + 12, osize);
+    put32(hdr + 16, n);
+
+    if (!(f = fopen(iname_idx, "wb")))
+        ERR_CLEANUP("cannot open '%s' for writing\n", iname_idx);
+    i = INDEX_HEADER_SIZE + n * INDEX_ENTRY_SIZE;
+    if (fwrite(hdr, 1, i, f) != i || fwrite(windows, 1, wsize, f) != wsize)
+        ERR_CLEANUP("cannot write to '%s'\n", iname_idx);
+
+    rv = 0;
+
+cleanup:
+    if (f && fclose(f) && !rv) {
+        fprintf(stderr, "Error: cannot write to '%s'\n", iname_idx);
+        rv = 1;
+    }
+    if (imapped)
+        unmap_file(idata, isize);
+    free(iname_idx);
+    free(hdr);
+    free(windows);
+    return rv;
+}
+
+/* Writes len bytes from offset off of the decompressed iname to oname (stdout
+ * if NULL), decompressing from the checkpoint before off in iname.idx, or
+ * from the start if there's no index. Returns 0 on success */
+int range_file(const char *iname, const char *oname, size_t off, size_t len)
+{
+    size_t isize = 0, osize = 0, xsize = 0, dsize = 0, ipos = 0, opos = 0, wlen = 0;
+    size_t n, i, w = 0, cap;
+    char *idata = 0, *iname_idx = 0, window[MOZLZ4_STREAM_WINDOW];
+    unsigned char *x;
+    buf_t ib = {0}, xb = {0}, ob = {0};
+    FILE *ofile = 0;
+    int rv = 1, imapped = 0, err;
+
+    if ((idata = map_file(iname, &isize)))
+        imapped = 1;
+    else if (!file_to_mem(iname, &ib, &isize))
+        idata = ib.data;
+    else
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (mozlz4_peek_size(idata, isize, &osize))
+        ERR_CLEANUP("'%s': unsupported file format\n", iname);
+    if (off > osize)
+        ERR_CLEANUP("'%s': the range starts after the end (%lu bytes)\n", iname, (unsigned long)osize);
+    if (len > osize - off)
+        len = osize - off;
+
+    /* the last checkpoint at or before off, and its window */
+    if (!(iname_idx = index_name(iname)))
+        ERR_CLEANUP("cannot allocate memory\n");
+    if (file_to_mem(iname_idx, &xb, &xsize)) {
+        fprintf(stderr, "Warning: cannot read '%s', decompressing from the start\n", iname_idx);
+    } else {
+        x = (unsigned char *)xb.data;
+        if (xsize < INDEX_HEADER_SIZE || memcmp(x, INDEX_MAGIC, sizeof INDEX_MAGIC)
+            || (n = get32(x + 16)) > (xsize - INDEX_HEADER_SIZE) / INDEX_ENTRY_SIZE)
+            ERR_CLEANUP("'%s': unsupported index format\n", iname_idx);
+        if (get32(x + 8) != isize || get32(x + 12) != osize)
+            ERR_CLEANUP("'%s': stale index, it's not of '%s'\n", iname_idx, iname);
+        for (i = 0; i < n && get32(x + INDEX_HEADER_SIZE + i * INDEX_ENTRY_SIZE + 4) <= off; i++) {
+            const unsigned char *e = x + INDEX_HEADER_SIZE + i * INDEX_ENTRY_SIZE;
+            ipos = get32(e);
+            opos = get32(e + 4);
+            w += wlen;
+            wlen = get32(e + 8);
+        }
+        x += INDEX_HEADER_SIZE + n * INDEX_ENTRY_SIZE;  /* the windows */
+        xsize -= INDEX_HEADER_SIZE + n * INDEX_ENTRY_SIZE;
+        if (w > xsize || wlen > xsize - w)
+            ERR_CLEANUP("'%s': unsupported index format\n", iname_idx);
+        if (wlen)
+            wlen = LZ4_decompress_safe((const char *)x + w, window, (int)wlen, sizeof window);
+        if (wlen != (opos < sizeof window ? opos : sizeof window))
+            ERR_CLEANUP("'%s': stale index, it's not of '%s'\n", iname_idx, iname);
+    }
+
+    /* decompress till off + len, with some room for the sequence which ends there */
+    cap = off + len - opos + INDEX_INTERVAL / 16;
+    for (;;) {
+        if (buf_reserve(&ob, cap ? cap : 1))
+            ERR_CLEANUP("cannot allocate memory for output\n");
+        err = mozlz4_decode_from(idata, isize, ipos, opos, window, wlen,
+                                 ob.data, cap, off + len - opos, &dsize);
+        if (err != MOZLZ4_ERR_SIZE)
+            break;
+        cap = osize - opos;  /* always enough */
+    }
+    if (err)
+        ERR_CLEANUP("'%s': decompression failed: malformed data\n", iname);
+    if (dsize < off + len - opos) {
+        fprintf(stderr, "Warning: '%s': decompressed file smaller than expected\n", iname);
+        len = dsize > off - opos ? dsize - (off - opos) : 0;
+    }
 
-    /* write output */
     if (!(ofile = oname ? fopen(oname, "wb") : stdout))
         ERR_CLEANUP("cannot open '%s' for writing\n", oname);
     if (!oname && ensure_binary(ofile))
         fprintf(stderr, "Warning: cannot set stdout to binary mode\n");
-    if (dsize != fwrite(odata, 1, dsize, ofile))
+    if (len != fwrite(ob.data + (off - opos), 1, len, ofile))
         ERR_CLEANUP("cannot write to '%s'\n", oname ? oname : "<stdout>");
 
     rv = 0;
 
 cleanup:
-    if (ofile && oname)
-        fclose(ofile);
-    if (odata)
-        free(odata);
-    if (idata)
-        free(idata);
+    if (ofile && oname && fclose(ofile) && !rv) {
+        fprintf(stderr, "Error: cannot write to '%s'\n", oname);
+        rv = 1;
+    }
+    if (imapped)
+        unmap_file(idata, isize);
+    free(iname_idx);
+    free(ib.data);
+    free(xb.data);
+    free(ob.data);
+    return rv;
+}
+
+/* Prints str as a JSON string to f */
+void print_json_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+/* Keeps multi-call output lines whole when several threads print */
+pthread_mutex_t stdout_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Prints the decompressed size of iname from its header, its size, and their
+ * ratio, as text or as a JSON object line. Returns 0 on success */
+int info_file(const char *iname, int json)
+{
+    unsigned char hdr[MOZLZ4_HEADER_SIZE];
+    unsigned long long osize, isize;
+    FILE *f = fopen(iname, "rb");
+    size_t size;
+    int rv = 1;
+
+    if (!f || setvbuf(f, 0, _IONBF, 0))
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (fread(hdr, 1, sizeof hdr, f) != sizeof hdr || mozlz4_peek_size(hdr, sizeof hdr, &size))
+        ERR_CLEANUP("'%s': unsupported file format\n", iname);
+    if (!(isize = known_size(f)))
+        ERR_CLEANUP("'%s': not a regular file\n", iname);
+    osize = size;
+
+    if (json) {
+        pthread_mutex_lock(&stdout_lock);
+        printf("{\"file\":");
+        print_json_string(stdout, iname);
+        printf(",\"decompressed\":%llu,\"compressed\":%llu,\"ratio\":%.3f}\n",
+               osize, isize, (double)osize / isize);
+        pthread_mutex_unlock(&stdout_lock);
+    } else {
+        printf("%12llu %12llu %7.3f  %s\n", osize, isize, (double)osize / isize, iname);
+    }
+    rv = 0;
+
+cleanup:
+    if (f)
+        fclose(f);
+    return rv;
+}
+
+/*
+   Grep (--grep): the output is searched for a literal pattern as it's
+   decoded, without writing it anywhere. Candidates are found using memchr for
+   the byte of the pattern which is likely the least common in JSON text, so
+   most of the output is skipped at memchr speed. The last len - 1 bytes of
+   each chunk are kept, for matches which continue in the next chunk.
+*/
+typedef struct {
+    const char *name;
+    const unsigned char *pat;
+    size_t len, rare;         /* the pattern length, and its rarest byte */
+    int files_only;           /* stop at the first match */
+    int found;
+    unsigned long long pos;   /* of the next chunk in the output */
+    unsigned long long next;  /* matches start here or later (they don't overlap) */
+    size_t tail;              /* the bytes of buf which precede the chunk */
+    unsigned char *buf;       /* of 2 * len bytes */
+} grep_t;
+
+/* The number of files which have matches */
+unsigned long grep_matched;
+
+/* Returns the index of the byte of pat which is likely the least common */
+size_t rare_byte(const unsigned char *pat, size_t len)
+{
+    /* in JSON text, roughly from the most common */
+    static const char common[] = "\":,e/t.a0o1i2nsr3hl4d5c6u7m8p9f{}gwy_-bvkxjqz";
+    size_t i, best = 0, max = 0;
+    for (i = 0; i < len; i++) {
+        const char *c = pat[i] ? strchr(common, pat[i]) : 0;
+        size_t rank = c ? (size_t)(c - common) : sizeof common;
+        if (!i || rank > max) {
+            max = rank;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Reports the matches in s (of n bytes, at pos in the output) which start in
+ * its first starts bytes. Returns non-zero to stop */
+int grep_find(grep_t *g, const unsigned char *s, size_t n, size_t starts, unsigned long long pos)
+{
+    const unsigned char *q;
+    size_t i = 0;
+
+    if (n < g->len)
+        return 0;
+    if (starts > n - g->len + 1)
+        starts = n - g->len + 1;
+    while (i < starts && (q = memchr(s + i + g->rare, g->pat[g->rare], starts - i))) {
+        i = q - s - g->rare;
+        if (pos + i >= g->next && !memcmp(s + i, g->pat, g->len)) {
+            pthread_mutex_lock(&stdout_lock);
+            if (!g->found)
+                grep_matched++;
+            if (g->files_only)
+                printf("%s\n", g->name);
+            else
+                printf("%s:%llu\n", g->name, pos + i);
+            pthread_mutex_unlock(&stdout_lock);
+            g->found = 1;
+            if (g->files_only)
+                return 1;
+            g->next = pos + i + g->len;
+        }
+        i++;
+    }
+    return 0;
+}
+
+/* A write callback which searches the output. Returns non-zero to stop */
+int grep_write(void *grep, const void *buf, size_t size)
+{
+    grep_t *g = grep;
+    const unsigned char *p = buf;
+    size_t keep = g->len - 1, n = size < keep ? size : keep, drop;
+
+    /* the matches which start in the tail of the previous chunks */
+    memcpy(g->buf + g->tail, p, n);
+    if (g->tail && grep_find(g, g->buf, g->tail + n, g->tail, g->pos - g->tail))
+        return 1;
+    if (grep_find(g, p, size, size, g->pos))
+        return 1;
+
+    g->pos += size;
+    if (size >= keep) {
+        memcpy(g->buf, p + size - keep, keep);
+        g->tail = keep;
+    } else {
+        drop = g->tail + n > keep ? g->tail + n - keep : 0;
+        memmove(g->buf, g->buf + drop, g->tail + n - drop);
+        g->tail += n - drop;
+    }
+    return 0;
+}
+
+/* Prints the offsets in the output of iname where the pattern o->grep starts,
+ * or only the name if it's there (then decoding stops at the first match).
+ * Returns 0 on success, whether or not it's there */
+int grep_file(const char *iname, const stream_opts_t *o)
+{
+    mozlz4_stream_t *s = 0;
+    grep_t g = {0};
+    FILE *f = 0;
+    int rv = 1, err;
+
+    g.name = iname;
+    g.pat = (const unsigned char *)o->grep;
+    g.len = strlen(o->grep);
+    g.rare = rare_byte(g.pat, g.len);
+    g.files_only = o->files_only;
+    if (!(s = malloc(sizeof *s)) || !(g.buf = malloc(2 * g.len)))
+        ERR_CLEANUP("cannot allocate memory\n");
+    if (!(f = fopen(iname, "rb")))
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+
+    mozlz4_stream_init(s, read_file, f, grep_write, &g);
+    if ((err = mozlz4_stream_header(s)) == MOZLZ4_ERR_READ)
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (err)
+        ERR_CLEANUP("'%s': unsupported file format\n", iname);
+    err = mozlz4_stream_decode(s, o->stop);
+    if (err == MOZLZ4_ERR_WRITE && g.found && g.files_only)
+        err = MOZLZ4_OK;  /* stopped at the first match */
+    if (err == MOZLZ4_ERR_FORMAT)
+        ERR_CLEANUP("'%s': decompression failed: malformed data\n", iname);
+    if (err)
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    rv = 0;
+
+cleanup:
+    if (f)
+        fclose(f);
+    free(g.buf);
+    free(s);
+    return rv;
+}
+
+/*
+   URL index (--url-index): the bookmarks of many backups, by URL, so that the
+   backups which have a URL are found without decompressing them. It's updated
+   in place: only the files which are new, or whose size, mtime or decompressed
+   size changed, are decompressed, and the files which weren't given are
+   dropped.
+
+   URLs are normalized: the scheme and the host are in lower case, without a
+   default port (80 for http, 443 for https) and without the fragment, and an
+   empty path is '/'. Others (e.g. place: or javascript:) are only changed to
+   a lower case scheme.
+
+   The file:
+   - Header: the magic "mozLz4u\0", the number of files, of URLs and of
+     buckets (a power of 2), and the offset of the files.
+   - Buckets: the hash (FNV-1a) of a URL and the offset of its entry, or 0 if
+     it's empty, with linear probing.
+   - URL entries: the URL length and the number of files which have it, their
+     indices (ascending), and the URL.
+   - Files: the size, mtime and date of the backup (from its name,
+     bookmarks-YYYY-MM-DD..., or else mtime) as 8 bytes, the decompressed size
+     and the name length, and the name.
+   The numbers are 4 bytes little endian, unless noted otherwise.
+*/
+#define URLS_MAGIC        "mozLz4u"  /* sizeof is 8, with the terminating \0 */
+#define URLS_HEADER_SIZE  24
+#define URLS_BUCKET_SIZE  8
+#define URLS_ENTRY_SIZE   8          /* without the files and the URL */
+#define URLS_FILE_SIZE    32         /* without the name */
+
+/* the states of the files */
+#define UFILE_OLD   0   /* from the index, and wasn't given (yet) */
+#define UFILE_KEEP  1   /* from the index, unchanged */
+#define UFILE_DROP  2   /* from the index, changed */
+#define UFILE_NEW   3   /* decompressed now */
+#define UFILE_FAIL  4   /* given, but couldn't be decompressed */
+
+typedef struct {
+    char *name;
+    unsigned long long size, mtime, date;
+    size_t osize;
+    int state;
+} ufile_t;
+
+typedef struct {
+    unsigned hash;
+    size_t n, cap;
+    unsigned *files;    /* indices, ascending */
+    size_t len;
+    char url[1];        /* allocated as needed */
+} url_t;
+
+typedef struct {
+    pthread_mutex_t lock;  /* the workers add files and URLs */
+    int nomem;             /* then the index is incomplete */
+    ufile_t *files;
+    size_t nfiles, fcap;
+    url_t **table;         /* open addressing, of mask + 1 slots */
+    size_t nurls, mask;
+} urlidx_t;
+
+void put64(unsigned char *p, unsigned long long v)
+{
+    put32(p, (size_t)(v & 0xffffffff));
+    put32(p + 4, (size_t)(v >> 32));
+}
+
+unsigned long long get64(const unsigned char *p)
+{
+    return get32(p) | (unsigned long long)get32(p + 4) << 32;
+}
+
+unsigned url_hash(const char *s, size_t len)
+{
+    unsigned h = 2166136261U;
+    while (len--)
+        h = (h ^ (unsigned char)*s++) * 16777619U;
+    return h;
+}
+
+char lower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* Writes the URL s of len bytes normalized to out, which has at least len + 1
+ * bytes. Returns its length */
+size_t normalize_url(const char *s, size_t len, char *out)
+{
+    size_t i, j, host, port, end, frag;
+
+    for (i = 0; i < len && (is_digit(s[i]) || (lower(s[i]) >= 'a' && lower(s[i]) <= 'z')
+                            || s[i] == '+' || s[i] == '-' || s[i] == '.'); i++)
+        out[i] = lower(s[i]);
+    if (!i || i == len || s[i] != ':') {
+        memcpy(out, s, len);  /* not a URL */
+        return len;
+    }
+    if (len - i < 3 || memcmp(s + i, "://", 3)) {
+        memcpy(out + i, s + i, len - i);
+        return len;
+    }
+
+    /* the authority: user info, host and port */
+    for (end = i + 3; end < len && s[end] != '/' && s[end] != '?' && s[end] != '#'; end++)
+        ;
+    for (host = j = i + 3; j < end; j++) {
+        if (s[j] == '@')
+            host = j + 1;
+    }
+    for (port = end; port > host && is_digit(s[port - 1]); port--)
+        ;
+    if (port > host && s[port - 1] == ':' && (s[host] != '[' || s[port - 2] == ']'))
+        port--;
+    else
+        port = end;
+    memcpy(out + i, s + i, host - i);
+    for (j = host; j < port; j++)
+        out[j] = lower(s[j]);
+    if (!(end - port == 3 && i == 4 && !memcmp(out, "http:", 5) && !memcmp(s + port, ":80", 3))
+        && !(end - port == 4 && i == 5 && !memcmp(out, "https:", 6) && !memcmp(s + port, ":443", 4)))
+    {
+        memcpy(out + port, s + port, end - port);
+        port = end;
+    }
+
+    /* the path and the query */
+    for (frag = end; frag < len && s[frag] != '#'; frag++)
+        ;
+    if (end == frag || s[end] != '/')
+        out[port++] = '/';
+    memcpy(out + port, s + end, frag - end);
+    return port + frag - end;
+}
+
+/* Returns the slot of url (of len bytes and hash h) in u, where its entry is,
+ * or where it should be added if it's empty. Returns NULL on OOM */
+url_t **url_slot(urlidx_t *u, unsigned h, const char *url, size_t len)
+{
+    size_t i;
+    url_t *e;
+
+    if ((u->nurls + 1) * 2 > u->mask + 1) {
+        size_t mask = u->mask ? u->mask * 2 + 1 : 1023;
+        url_t **table = calloc(mask + 1, sizeof *table);
+        if (!table)
+            return 0;
+        for (i = 0; i <= u->mask && u->table; i++) {
+            size_t k;
+            if (!(e = u->table[i]))
+                continue;
+            for (k = e->hash & mask; table[k]; k = (k + 1) & mask)
+                ;
+            table[k] = e;
+        }
+        free(u->table);
+        u->table = table;
+        u->mask = mask;
+    }
+
+    for (i = h & u->mask; (e = u->table[i]); i = (i + 1) & u->mask) {
+        if (e->hash == h && e->len == len && !memcmp(e->url, url, len))
+            break;
+    }
+    return &u->table[i];
+}
+
+/* Returns the entry of url (of len bytes) in u, which is added if needed, or
+ * NULL on OOM */
+url_t *url_entry(urlidx_t *u, const char *url, size_t len)
+{
+    unsigned h = url_hash(url, len);
+    url_t **slot = url_slot(u, h, url, len), *e;
+
+    if (!slot)
+        return 0;
+    if (*slot)
+        return *slot;
+    if (!(e = calloc(1, sizeof *e + len)))
+        return 0;
+    e->hash = h;
+    e->len = len;
+    memcpy(e->url, url, len);
+    *slot = e;
+    u->nurls++;
+    return e;
+}
+
+/* Adds file to e, unless it's there already, keeping the files ascending.
+ * Returns non-zero on OOM */
+int url_add_file(url_t *e, unsigned file)
+{
+    size_t i;
+    if (e->n && e->files[e->n - 1] == file)
+        return 0;  /* again in this file */
+    if (e->n == e->cap) {
+        size_t cap = e->cap ? e->cap * 2 : 4;
+        unsigned *files = realloc(e->files, cap * sizeof *files);
+        if (!files)
+            return 1;
+        e->files = files;
+        e->cap = cap;
+    }
+    for (i = e->n; i && e->files[i - 1] > file; i--)
+        ;  /* usually at the end */
+    if (i && e->files[i - 1] == file)
+        return 0;
+    memmove(e->files + i + 1, e->files + i, (e->n - i) * sizeof *e->files);
+    e->files[i] = file;
+    e->n++;
+    return 0;
+}
+
+/* Adds a file to u. Returns its index, or -1 on OOM */
+long ufile_add(urlidx_t *u, const char *name, unsigned long long size,
+               unsigned long long mtime, unsigned long long date, size_t osize, int state)
+{
+    ufile_t *f;
+    if (u->nfiles == u->fcap) {
+        size_t cap = u->fcap ? u->fcap * 2 : 64;
+        if (!(f = realloc(u->files, cap * sizeof *f)))
+            return -1;
+        u->files = f;
+        u->fcap = cap;
+    }
+    f = &u->files[u->nfiles];
+    if (!(f->name = strdup(name)))
+        return -1;
+    f->size = size;
+    f->mtime = mtime;
+    f->date = date;
+    f->osize = osize;
+    f->state = state;
+    return (long)u->nfiles++;
+}
+
+void urls_free(urlidx_t *u)
+{
+    size_t i;
+    for (i = 0; i < u->nfiles; i++)
+        free(u->files[i].name);
+    for (i = 0; i <= u->mask && u->table; i++) {
+        if (u->table[i]) {
+            free(u->table[i]->files);
+            free(u->table[i]);
+        }
+    }
+    free(u->files);
+    free(u->table);
+}
+
+/* The date of a Firefox backup from its name (bookmarks-YYYY-MM-DD...), in
+ * seconds since the epoch, or 0 if it doesn't have one */
+unsigned long long backup_date(const char *name)
+{
+    const char *p = name, *q;
+    long y, m, d, era, yoe, doy;
+
+    for (q = name; *q; q++) {
+        if (*q == '/' || *q == '\\')
+            p = q + 1;
+    }
+    if (strncmp(p, "bookmarks-", 10) || sscanf(p + 10, "%4ld-%2ld-%2ld", &y, &m, &d) != 3
+        || y < 1970 || m < 1 || m > 12 || d < 1 || d > 31)
+        return 0;
+
+    /* days since 1970-01-01 of the proleptic Gregorian calendar */
+    y -= m <= 2;
+    era = y / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    return (era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468) * 86400ULL;
+}
+
+/* Reads the index iname into u, unless it doesn't exist. Returns 0 on success */
+int urls_load(urlidx_t *u, const char *iname)
+{
+    size_t size = 0, nfiles, nurls, nbuckets, foff, pos, k, i;
+    const unsigned char *p;
+    long file;
+    buf_t b = {0};
+    struct stat st;
+    int rv = 1;
+
+    if (stat(iname, &st))
+        return 0;  /* a new index */
+    if (file_to_mem(iname, &b, &size))
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    p = (const unsigned char *)b.data;
+    if (size < URLS_HEADER_SIZE || memcmp(p, URLS_MAGIC, sizeof URLS_MAGIC))
+        ERR_CLEANUP("'%s': unsupported file format\n", iname);
+    nfiles = get32(p + 8);
+    nurls = get32(p + 12);
+    nbuckets = get32(p + 16);
+    foff = get32(p + 20);
+    if (foff > size || (foff - URLS_HEADER_SIZE) / URLS_BUCKET_SIZE < nbuckets)
+        ERR_CLEANUP("'%s': malformed index\n", iname);
+
+    for (pos = foff, k = 0; k < nfiles; k++) {
+        size_t nlen;
+        char *name;
+        if (size - pos < URLS_FILE_SIZE || size - pos - URLS_FILE_SIZE < (nlen = get32(p + pos + 28)))
+            ERR_CLEANUP("'%s': malformed index\n", iname);
+        if (!(name = malloc(nlen + 1)))
+            ERR_CLEANUP("cannot allocate memory\n");
+        memcpy(name, p + pos + URLS_FILE_SIZE, nlen);
+        name[nlen] = 0;
+        file = ufile_add(u, name, get64(p + pos), get64(p + pos + 8), get64(p + pos + 16),
+                         get32(p + pos + 24), UFILE_OLD);
+        free(name);
+        if (file < 0)
+            ERR_CLEANUP("cannot allocate memory\n");
+        pos += URLS_FILE_SIZE + nlen;
+    }
+
+    for (pos = URLS_HEADER_SIZE + nbuckets * URLS_BUCKET_SIZE, k = 0; k < nurls; k++) {
+        size_t len, n;
+        url_t *e;
+        if (foff - pos < URLS_ENTRY_SIZE)
+            ERR_CLEANUP("'%s': malformed index\n", iname);
+        len = get32(p + pos);
+        n = get32(p + pos + 4);
+        pos += URLS_ENTRY_SIZE;
+        if ((foff - pos) / 4 < n || foff - pos - n * 4 < len)
+            ERR_CLEANUP("'%s': malformed index\n", iname);
+        if (!(e = url_entry(u, (const char *)p + pos + n * 4, len)))
+            ERR_CLEANUP("cannot allocate memory\n");
+        for (i = 0; i < n; i++, pos += 4) {
+            size_t f = get32(p + pos);
+            if (f >= nfiles || (e->n && f <= e->files[e->n - 1]))
+                ERR_CLEANUP("'%s': malformed index\n", iname);
+            if (url_add_file(e, (unsigned)f))
+                ERR_CLEANUP("cannot allocate memory\n");
+        }
+        pos += len;
+    }
+    rv = 0;
+
+cleanup:
+    free(b.data);
+    return rv;
+}
+
+/* Writes u, without the files which are old or dropped, to oname. Returns 0
+ * on success */
+int urls_save(urlidx_t *u, const char *oname)
+{
+    size_t nbuckets = 16, nurls = 0, nfiles = 0, pos, i, k;
+    unsigned char hdr[URLS_HEADER_SIZE + URLS_FILE_SIZE], *buckets = 0;
+    unsigned *remap = malloc((u->nfiles + 1) * sizeof *remap);
+    char *tmp = malloc(strlen(oname) + 5);
+    buf_t b = {0};
+    FILE *f = 0;
+    int rv = 1;
+
+    if (!remap || !tmp)
+        ERR_CLEANUP("cannot allocate memory\n");
+    for (i = 0; i < u->nfiles; i++) {
+        int keep = u->files[i].state == UFILE_KEEP || u->files[i].state == UFILE_NEW;
+        remap[i] = keep ? (unsigned)nfiles++ : (unsigned)-1;
+    }
+
+    /* the files of each URL, renumbered, and the URLs which are left */
+    for (i = 0; i <= u->mask && u->table; i++) {
+        url_t *e = u->table[i];
+        size_t n = 0;
+        if (!e)
+            continue;
+        for (k = 0; k < e->n; k++) {
+            if (remap[e->files[k]] != (unsigned)-1)
+                e->files[n++] = remap[e->files[k]];
+        }
+        if ((e->n = n))
+            nurls++;
+    }
+    while (nbuckets < nurls * 2)
+        nbuckets *= 2;
+    if (!(buckets = calloc(nbuckets, URLS_BUCKET_SIZE)))
+        ERR_CLEANUP("cannot allocate memory\n");
+    pos = URLS_HEADER_SIZE + nbuckets * URLS_BUCKET_SIZE;
+    for (i = 0; i <= u->mask && u->table; i++) {
+        url_t *e = u->table[i];
+        if (!e || !e->n)
+            continue;
+        for (k = e->hash & (nbuckets - 1); get32(buckets + k * URLS_BUCKET_SIZE + 4);
+             k = (k + 1) & (nbuckets - 1))
+            ;
+        put32(buckets + k * URLS_BUCKET_SIZE, e->hash);
+        put32(buckets + k * URLS_BUCKET_SIZE + 4, pos);
+        pos += URLS_ENTRY_SIZE + e->n * 4 + e->len;
+        if (pos > 0xffffffff)
+            ERR_CLEANUP("the index '%s' is too large\n", oname);
+    }
+
+    memcpy(hdr, URLS_MAGIC, sizeof URLS_MAGIC);
+    put32(hdr + 8, nfiles);
+    put32(hdr + 12, nurls);
+    put32(hdr + 16, nbuckets);
+    put32(hdr + 20, pos);
+    strcat(strcpy(tmp, oname), ".tmp");
+    if (!(f = fopen(tmp, "wb")))
+        ERR_CLEANUP("cannot open '%s' for writing\n", tmp);
+    if (fwrite(hdr, 1, URLS_HEADER_SIZE, f) != URLS_HEADER_SIZE
+        || fwrite(buckets, URLS_BUCKET_SIZE, nbuckets, f) != nbuckets)
+        ERR_CLEANUP("cannot write to '%s'\n", tmp);
+    for (i = 0; i <= u->mask && u->table; i++) {
+        url_t *e = u->table[i];
+        size_t n;
+        if (!e || !e->n)
+            continue;
+        n = URLS_ENTRY_SIZE + e->n * 4;
+        if (buf_reserve(&b, n))
+            ERR_CLEANUP("cannot allocate memory\n");
+        put32((unsigned char *)b.data, e->len);
+        put32((unsigned char *)b.data + 4, e->n);
+        for (k = 0; k < e->n; k++)
+            put32((unsigned char *)b.data + URLS_ENTRY_SIZE + k * 4, e->files[k]);
+        if (fwrite(b.data, 1, n, f) != n || fwrite(e->url, 1, e->len, f) != e->len)
+            ERR_CLEANUP("cannot write to '%s'\n", tmp);
+    }
+    for (i = 0; i < u->nfiles; i++) {
+        const ufile_t *uf = &u->files[i];
+        size_t nlen = strlen(uf->name);
+        if (remap[i] == (unsigned)-1)
+            continue;
+        put64(hdr, uf->size);
+        put64(hdr + 8, uf->mtime);
+        put64(hdr + 16, uf->date);
+        put32(hdr + 24, uf->osize);
+        put32(hdr + 28, nlen);
+        if (fwrite(hdr, 1, URLS_FILE_SIZE, f) != URLS_FILE_SIZE || fwrite(uf->name, 1, nlen, f) != nlen)
+            ERR_CLEANUP("cannot write to '%s'\n", tmp);
+    }
+    i = fclose(f);
+    f = 0;
+    if (i)
+        ERR_CLEANUP("cannot write to '%s'\n", tmp);
+#ifdef _WIN32
+    remove(oname);  /* rename doesn't replace files */
+#endif
+    if (rename(tmp, oname))
+        ERR_CLEANUP("cannot rename '%s' to '%s'\n", tmp, oname);
+    rv = 0;
+
+cleanup:
+    if (f) {
+        fclose(f);
+        remove(tmp);
+    }
+    free(b.data);
+    free(buckets);
+    free(remap);
+    free(tmp);
+    return rv;
+}
+
+/* The URLs of a file, which are added to urls as the exporter writes them, a
+ * line at a time */
+typedef struct {
+    urlidx_t *urls;
+    unsigned file;
+    buf_t line, norm;
+    size_t len;  /* of the line so far */
+} url_sink_t;
+
+/* Adds the URL in the line of s (escaped as with TSV), and empties the line.
+ * Returns non-zero on OOM */
+int url_line(url_sink_t *s)
+{
+    char *p = s->line.data, *end = p + s->len, *q = p;
+    url_t *e;
+
+    s->len = 0;
+    for (; p < end; p++) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+            *p = *p == 't' ? '\t' : *p == 'n' ? '\n' : *p == 'r' ? '\r' : *p;
+        }
+        *q++ = *p;
+    }
+    if (q == s->line.data)
+        return 0;
+    if (buf_reserve(&s->norm, q - s->line.data + 1))
+        return 1;
+    e = url_entry(s->urls, s->norm.data, normalize_url(s->line.data, q - s->line.data, s->norm.data));
+    return !e || url_add_file(e, s->file);
+}
+
+/* A write callback which adds the URLs of each complete line to a url_sink_t */
+int write_urls(void *sink, const void *buf, size_t size)
+{
+    url_sink_t *s = sink;
+    const char *p = buf, *nl;
+    size_t n;
+
+    while (size) {
+        n = (nl = memchr(p, '\n', size)) ? (size_t)(nl - p) : size;
+        if (n) {
+            if (buf_reserve(&s->line, s->len + n))
+                return 1;
+            memcpy(s->line.data + s->len, p, n);
+            s->len += n;
+        }
+        if (!nl)
+            break;
+        if (url_line(s))
+            return 1;
+        p = nl + 1;
+        size -= n + 1;
+    }
+    return 0;
+}
+
+/* Adds the URLs of the bookmarks in iname to u, unless it's in u and
+ * unchanged, or was given already. Returns 0 on success */
+int url_file(const char *iname, urlidx_t *u)
+{
+    mozlz4_stream_t *s = 0;
+    json_exp_t *x = 0;
+    urlidx_t mine;  /* the URLs of this file, merged into u at the end */
+    url_sink_t out;
+    struct stat st;
+    FILE *f = 0;
+    unsigned long long date;
+    long file = -1;
+    size_t i;
+    int rv = 1, err, state;
+
+    memset(&mine, 0, sizeof mine);
+    memset(&out, 0, sizeof out);
+    if (!(f = fopen(iname, "rb")) || stat(iname, &st))
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (!(s = malloc(sizeof *s)) || !(x = calloc(1, sizeof *x)))
+        ERR_CLEANUP("cannot allocate memory\n");
+    mozlz4_stream_init(s, read_file, f, json_exp_write, x);
+    if ((err = mozlz4_stream_header(s)) == MOZLZ4_ERR_READ)
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (err)
+        ERR_CLEANUP("'%s': unsupported file format\n", iname);
+
+    /* keep it if it's unchanged, or else add it now, so that if it's given
+     * again it's skipped */
+    pthread_mutex_lock(&u->lock);
+    for (i = 0, state = UFILE_NEW; i < u->nfiles && state == UFILE_NEW; i++) {
+        ufile_t *uf = &u->files[i];
+        if (uf->state == UFILE_DROP || strcmp(uf->name, iname))
+            continue;
+        if (uf->state != UFILE_OLD)
+            state = UFILE_KEEP;  /* given again */
+        else if (uf->size == (unsigned long long)st.st_size && uf->mtime == (unsigned long long)st.st_mtime
+                 && uf->osize == s->size)
+            state = uf->state = UFILE_KEEP;
+        else
+            uf->state = UFILE_DROP;
+    }
+    if (state == UFILE_NEW) {
+        date = backup_date(iname);
+        if ((file = ufile_add(u, iname, st.st_size, st.st_mtime, date ? date : (unsigned long long)st.st_mtime,
+                              s->size, UFILE_NEW)) < 0)
+            u->nomem = 1;
+    }
+    pthread_mutex_unlock(&u->lock);
+    if (state == UFILE_KEEP) {
+        rv = 0;  /* already in the index */
+        goto cleanup;
+    }
+    if (file < 0)
+        ERR_CLEANUP("cannot allocate memory\n");
+
+    out.urls = &mine;
+    out.file = (unsigned)file;
+    json_exp_init(x, JSON_EXPORT_URI, write_urls, &out);
+    err = mozlz4_stream_decode(s, (size_t)-1);
+    if (!err && (json_exp_end(x) || url_line(&out)))
+        err = MOZLZ4_ERR_WRITE;
+    if (x->nomem || err == MOZLZ4_ERR_WRITE)
+        ERR_CLEANUP("cannot allocate memory\n");
+    if (x->bad)
+        ERR_CLEANUP("'%s': the decompressed data isn't JSON\n", iname);
+    if (err == MOZLZ4_ERR_FORMAT)
+        ERR_CLEANUP("'%s': decompression failed: malformed data\n", iname);
+    if (err == MOZLZ4_ERR_READ)
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+
+    /* merge: the entries which are new to u move there as they are */
+    pthread_mutex_lock(&u->lock);
+    for (i = 0, err = 0; i <= mine.mask && mine.table && !err; i++) {
+        url_t *e = mine.table[i], **slot;
+        if (!e)
+            continue;
+        if (!(slot = url_slot(u, e->hash, e->url, e->len)) || (*slot && url_add_file(*slot, (unsigned)file)))
+            err = u->nomem = 1;
+        else if (!*slot) {
+            *slot = e;
+            u->nurls++;
+            mine.table[i] = 0;
+        }
+    }
+    pthread_mutex_unlock(&u->lock);
+    if (err)
+        ERR_CLEANUP("cannot allocate memory\n");
+    rv = 0;
+
+cleanup:
+    if (rv && file >= 0) {
+        pthread_mutex_lock(&u->lock);
+        u->files[file].state = UFILE_FAIL;
+        pthread_mutex_unlock(&u->lock);
+    }
+    if (f)
+        fclose(f);
+    if (x)
+        json_exp_free(x);
+    urls_free(&mine);
+    free(out.line.data);
+    free(out.norm.data);
+    free(x);
+    free(s);
+    return rv;
+}
+
+/* Seeks f to off, which fails if it doesn't fit in a long (fseek's offset).
+ * Returns 0 on success */
+int seek_to(FILE *f, size_t off)
+{
+    return off > LONG_MAX || fseek(f, (long)off, SEEK_SET);
+}
+
+/* Prints the first and the last backup in the index iname which have url,
+ * and their number. Returns 0 if url is in the index */
+int url_lookup(const char *iname, const char *url)
+{
+    unsigned char hdr[URLS_HEADER_SIZE], e[URLS_BUCKET_SIZE];
+    size_t len = strlen(url), nbuckets, nfiles, foff, fsize, n = 0, probes, i, k, pos;
+    size_t first = 0, last = 0;
+    char *norm = malloc(len + 1), date[16];
+    unsigned char *files = 0;
+    unsigned h;
+    buf_t b = {0};
+    FILE *f = 0;
+    int rv = 1;
+
+    if (!norm)
+        ERR_CLEANUP("cannot allocate memory\n");
+    len = normalize_url(url, len, norm);
+    h = url_hash(norm, len);
+    if (!(f = fopen(iname, "rb")))
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    if (fread(hdr, 1, sizeof hdr, f) != sizeof hdr || memcmp(hdr, URLS_MAGIC, sizeof URLS_MAGIC))
+        ERR_CLEANUP("'%s': unsupported file format\n", iname);
+    nfiles = get32(hdr + 8);
+    nbuckets = get32(hdr + 16);
+    foff = get32(hdr + 20);
+
+    /* the bucket, then its entry */
+    for (i = h & (nbuckets - 1), probes = 0; probes < nbuckets; i = (i + 1) & (nbuckets - 1), probes++) {
+        if (seek_to(f, URLS_HEADER_SIZE + i * URLS_BUCKET_SIZE)
+            || fread(e, 1, sizeof e, f) != sizeof e)
+            ERR_CLEANUP("'%s': malformed index\n", iname);
+        if (!(pos = get32(e + 4)))
+            break;
+        if (get32(e) != h)
+            continue;
+        if (seek_to(f, pos) || fread(e, 1, URLS_ENTRY_SIZE, f) != URLS_ENTRY_SIZE)
+            ERR_CLEANUP("'%s': malformed index\n", iname);
+        n = get32(e + 4);
+        if (get32(e) != len || n > nfiles || buf_reserve(&b, n * 4 + len + 1)
+            || fread(b.data, 1, n * 4 + len, f) != n * 4 + len)
+        {
+            n = 0;
+            continue;
+        }
+        if (!memcmp(b.data + n * 4, norm, len))
+            break;
+        n = 0;
+    }
+    if (!n)
+        goto cleanup;  /* not in the index */
+
+    /* the files which have it */
+    if (seek_to(f, foff) || !(fsize = known_size(f)) || fsize < foff
+        || !(files = malloc(fsize - foff + 1)) || fread(files, 1, fsize - foff, f) != fsize - foff)
+        ERR_CLEANUP("cannot read file '%s'\n", iname);
+    fsize -= foff;
+    for (pos = 0, k = 0, i = 0; i < n; i++) {
+        size_t want = get32((unsigned char *)b.data + i * 4), at;
+        for (; k < want; k++) {
+            if (fsize - pos < URLS_FILE_SIZE || fsize - pos - URLS_FILE_SIZE < get32(files + pos + 28))
+                ERR_CLEANUP("'%s': malformed index\n", iname);
+            pos += URLS_FILE_SIZE + get32(files + pos + 28);
+        }
+        if (fsize - pos < URLS_FILE_SIZE)
+            ERR_CLEANUP("'%s': malformed index\n", iname);
+        at = pos;
+        if (!i || get64(files + at + 16) < get64(files + first + 16))
+            first = at;
+        if (!i || get64(files + at + 16) >= get64(files + last + 16))
+            last = at;
+    }
+    for (i = 0; i < 2; i++) {
+        const unsigned char *uf = files + (i ? last : first);
+        time_t t = (time_t)get64(uf + 16);
+        struct tm *tm = gmtime(&t);
+        size_t nlen = get32(uf + 28);
+        if (!tm || !strftime(date, sizeof date, "%Y-%m-%d", tm))
+            strcpy(date, "?");
+        if (uf + URLS_FILE_SIZE + nlen > files + fsize)
+            ERR_CLEANUP("'%s': malformed index\n", iname);
+        printf("%s %s %.*s\n", i ? "last: " : "first:", date, (int)nlen, (const char *)uf + URLS_FILE_SIZE);
+    }
+    printf("files: %lu\n", (unsigned long)n);
+    rv = 0;
+
+cleanup:
+    if (f)
+        fclose(f);
+    free(files);
+    free(norm);
+    free(b.data);
+    return rv;
+}
+
+/*
+   Batch mode: a queue of files which worker threads decompress. Jobs can be
+   added while the workers run, and the workers exit once the queue is closed
+   and empty. The queue holds up to QUEUE_AHEAD jobs per thread, and the input
+   of each job is prefetched when it's queued, so that reading the next files
+   overlaps with decompressing the current ones.
+*/
+#define QUEUE_AHEAD 4
+
+typedef struct job {
+    struct job *next;
+    char *oname;
+    char iname[1];  /* allocated as needed */
+} job_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    /* a job was added or the queue was closed */
+    pthread_cond_t space;   /* a job was removed */
+    job_t *head, *tail;
+    int pending, max_pending;
+    int closed;   /* no more jobs will be added */
+    int failed;   /* number of failed jobs */
+    int mode;     /* MODE_* */
+    const stream_opts_t *sopts;  /* for stream_file */
+    urlidx_t *urls;              /* for url_file */
+} queue_t;
+
+/* what batch jobs do */
+#define MODE_DECODE  0  /* decompress_file */
+#define MODE_STREAM  1  /* stream_file */
+#define MODE_INFO    2  /* info_file */
+#define MODE_JSON    3  /* info_file as JSON */
+#define MODE_URLS    4  /* url_file */
+#define MODE_GREP    5  /* grep_file */
+
+/* Returns the output name for iname: x.jsonlz4 -> x.json, x.mozlz4 -> x,
+ * and anything else gets .json appended. The result should be freed */
+char *out_name(const char *iname)
+{
+    size_t len = strlen(iname);
+    char *oname = malloc(len + sizeof ".json");
+    if (!oname)
+        return 0;
+    strcpy(oname, iname);
+    if (len > 7 && !strcmp(oname + len - 7, ".mozlz4"))
+        oname[len - 7] = 0;
+    else if (len > 8 && !strcmp(oname + len - 8, ".jsonlz4"))
+        oname[len - 3] = 0;
+    else
+        strcat(oname, ".json");
+    return oname;
+}
+
+/* Hints the OS to start reading fname in the background */
+void prefetch(const char *fname)
+{
+#if defined(HAVE_MMAP) && defined(POSIX_FADV_WILLNEED)
+    int fd = open(fname, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#else
+    (void)fname;
+#endif
+}
+
+/* Adds iname to q with output oname (or the default if NULL). Waits while the
+ * queue is full. Returns non-zero on failure */
+int queue_add(queue_t *q, const char *iname, const char *oname)
+{
+    job_t *j = malloc(sizeof *j + strlen(iname));
+    if (!j)
+        return 1;
+    strcpy(j->iname, iname);
+    j->next = 0;
+    j->oname = 0;
+    if (q->mode != MODE_INFO && q->mode != MODE_JSON && q->mode != MODE_URLS && q->mode != MODE_GREP
+        && !(j->oname = oname ? strdup(oname) : out_name(iname)))
+    {
+        free(j);
+        return 1;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    while (q->pending >= q->max_pending)
+        pthread_cond_wait(&q->space, &q->lock);
+    pthread_mutex_unlock(&q->lock);
+
+    prefetch(iname);  /* a worker will get to it soon */
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail)
+        q->tail->next = j;
+    else
+        q->head = j;
+    q->tail = j;
+    q->pending++;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+void queue_close(queue_t *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Thread function: decompress jobs till the queue is closed and empty */
+void *worker(void *arg)
+{
+    queue_t *q = arg;
+    buf_t ib = {0}, ob = {0};
+
+    for (;;) {
+        job_t *j;
+        int err;
+
+        pthread_mutex_lock(&q->lock);
+        while (!q->head && !q->closed)
+            pthread_cond_wait(&q->cond, &q->lock);
+        if ((j = q->head)) {
+            if (!(q->head = j->next))
+                q->tail = 0;
+            q->pending--;
+            pthread_cond_signal(&q->space);
+        }
+        pthread_mutex_unlock(&q->lock);
+        if (!j)
+            break;
+
+        if (q->mode == MODE_INFO || q->mode == MODE_JSON)
+            err = info_file(j->iname, q->mode == MODE_JSON);
+        else if (q->mode == MODE_STREAM)
+            err = stream_file(j->iname, j->oname, q->sopts);
+        else if (q->mode == MODE_URLS)
+            err = url_file(j->iname, q->urls);
+        else if (q->mode == MODE_GREP)
+            err = grep_file(j->iname, q->sopts);
+        else
+            err = decompress_file(j->iname, j->oname, &ib, &ob, 1);
+        if (err) {
+            pthread_mutex_lock(&q->lock);
+            q->failed++;
+            pthread_mutex_unlock(&q->lock);
+        }
+        free(j->oname);
+        free(j);
+    }
+
+    free(ib.data);
+    free(ob.data);
+    return 0;
+}
+
+/* Returns non-zero if fname starts with a mozLz40 header. Reads only 12 bytes */
+int is_mozlz4(const char *fname)
+{
+    unsigned char hdr[MOZLZ4_HEADER_SIZE];
+    FILE *f = fopen(fname, "rb");
+    size_t size;
+    int rv = 0;
+    if (!f)
+        return 0;
+    if (!setvbuf(f, 0, _IONBF, 0))
+        rv = fread(hdr, 1, sizeof hdr, f) == sizeof hdr && !mozlz4_peek_size(hdr, sizeof hdr, &size);
+    fclose(f);
+    return rv;
+}
+
+/* Creates the missing parent directories of fname. Errors are ignored, and
+ * surface when fname itself can't be created */
+void make_parents(char *fname)
+{
+    char *p;
+    for (p = fname + 1; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            char c = *p;
+            *p = 0;
+            MKDIR(fname);
+            *p = c;
+        }
+    }
+}
+
+/* Queues the mozLz40 files under the directory at path b (of length len). The
+ * output names are mirrored under outdir by replacing the first rootlen chars
+ * of the input names, or default to next to the inputs if outdir is NULL.
+ * Reports and skips unreadable directories. Returns non-zero on errors */
+int walk(queue_t *q, buf_t *b, size_t len, size_t rootlen, const char *outdir)
+{
+    struct dirent *e;
+    struct stat st;
+    int err = 0;
+    DIR *d = opendir(b->data);
+    if (!d) {
+        fprintf(stderr, "Error: cannot read directory '%s'\n", b->data);
+        return 1;
+    }
+
+    while ((e = readdir(d))) {
+        size_t nlen = strlen(e->d_name);
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+            continue;
+        if (buf_reserve(b, len + nlen + 2)) {
+            fprintf(stderr, "Error: cannot allocate memory\n");
+            err = 1;
+            break;
+        }
+        b->data[len] = '/';
+        memcpy(b->data + len + 1, e->d_name, nlen + 1);
+
+#ifndef _WIN32
+        /* links to files are followed, but links to directories are not */
+        if (lstat(b->data, &st) || (S_ISLNK(st.st_mode) && (stat(b->data, &st) || !S_ISREG(st.st_mode))))
+            continue;
+#else
+        if (stat(b->data, &st))
+            continue;
+#endif
+
+        if ((st.st_mode & S_IFMT) == S_IFDIR) {
+            err |= walk(q, b, len + 1 + nlen, rootlen, outdir);
+        } else if ((st.st_mode & S_IFMT) == S_IFREG && is_mozlz4(b->data)) {
+            char *oname = 0, *mirror;
+            if (outdir && (mirror = malloc(strlen(outdir) + len + nlen + 2))) {
+                sprintf(mirror, "%s%s", outdir, b->data + rootlen);
+                oname = out_name(mirror);
+                free(mirror);
+                if (oname)
+                    make_parents(oname);
+            }
+            if ((outdir && !oname) || queue_add(q, b->data, oname)) {
+                fprintf(stderr, "Error: cannot allocate memory\n");
+                free(oname);
+                err = 1;
+                break;
+            }
+            free(oname);
+        }
+    }
+
+    closedir(d);
+    b->data[len] = 0;
+    return err;
+}
+
+/* Reads a line from f into b without the EOL. Returns non-zero at EOF */
+int read_line(FILE *f, buf_t *b)
+{
+    size_t len = 0;
+    for (;;) {
+        if (buf_reserve(b, len + 256) || !fgets(b->data + len, b->size - len, f))
+            break;
+        len += strlen(b->data + len);
+        if (len && b->data[len - 1] == '\n')
+            break;
+    }
+    while (len && (b->data[len - 1] == '\n' || b->data[len - 1] == '\r'))
+        len--;
+    if (b->data)
+        b->data[len] = 0;
+    return !len && (feof(f) || ferror(f));
+}
+
+/* Decompresses files, the files listed at list ('-' is stdin), and the mozLz40
+ * files under dir (mirrored to outdir if not NULL), using nthreads threads.
+ * sopts are for MODE_STREAM and MODE_GREP, and urls for MODE_URLS. Returns 0 if all files
+ * were decompressed successfully */
+int batch(char **files, int nfiles, const char *list, const char *dir, const char *outdir,
+          int nthreads, int mode, const stream_opts_t *sopts, urlidx_t *urls)
+{
+    pthread_t *threads = calloc(nthreads, sizeof *threads);
+    queue_t q;
+    int i, started = 0, rv = 1, werr = 0;
+    buf_t line = {0};
+    FILE *f = 0;
+
+    memset(&q, 0, sizeof q);
+    pthread_mutex_init(&q.lock, 0);
+    pthread_cond_init(&q.cond, 0);
+    pthread_cond_init(&q.space, 0);
+    q.mode = mode;
+    q.sopts = sopts;
+    q.urls = urls;
+    q.max_pending = QUEUE_AHEAD * nthreads;
+    if (!threads)
+        ERR_CLEANUP("cannot allocate memory\n");
+    for (; started < nthreads; started++) {
+        if (pthread_create(&threads[started], 0, worker, &q))
+            ERR_CLEANUP("cannot create threads\n");
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        if (queue_add(&q, files[i], 0))
+            ERR_CLEANUP("cannot allocate memory\n");
+    }
+    if (list) {
+        if (!(f = strcmp(list, "-") ? fopen(list, "r") : stdin))
+            ERR_CLEANUP("cannot read file '%s'\n", list);
+        while (!read_line(f, &line)) {
+            if (line.data[0] && queue_add(&q, line.data, 0))
+                ERR_CLEANUP("cannot allocate memory\n");
+        }
+        if (ferror(f))
+            ERR_CLEANUP("cannot read file '%s'\n", list);
+    }
+    if (dir) {
+        size_t len = strlen(dir);
+        while (len > 1 && (dir[len - 1] == '/' || dir[len - 1] == '\\'))
+            len--;
+        if (buf_reserve(&line, len + 1))
+            ERR_CLEANUP("cannot allocate memory\n");
+        memcpy(line.data, dir, len);
+        line.data[len] = 0;
+        werr = walk(&q, &line, len, len, outdir);  /* the workers start meanwhile */
+    }
+
+    rv = werr;
+
+cleanup:
+    queue_close(&q);  /* on errors too: let the started workers exit */
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], 0);
+    if (f && f != stdin)
+        fclose(f);
+    pthread_cond_destroy(&q.space);
+    pthread_cond_destroy(&q.cond);
+    pthread_mutex_destroy(&q.lock);
+    free(line.data);
+    free(threads);
+    return rv || q.failed;
+}
+
+int main(int argc, char **argv)
+{
+    const char *iname = 0, *oname = 0, *list = 0, *dir = 0, *outdir = 0, *urls = 0, *lookup = 0;
+    int rv, i, stream = 0, nthreads = 0, parallel = 1, info = 0, json = 0, index = 0, range = 0;
+    stream_opts_t so = {0};
+    size_t roff = 0, rlen = 0;
+    buf_t ib = {0}, ob = {0};
+
+    so.stop = (size_t)-1;
+
+    /* process arguments */
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (!strcmp(argv[i], "-h"))
+            exit_usage(0);
+        else if (!strcmp(argv[i], "-s"))
+            stream = 1;
+        else if (!strcmp(argv[i], "--head") && i + 1 < argc) {
+            char *end;
+            so.stop = strtoul(argv[++i], &end, 10);
+            if (*end || end == argv[i] || argv[i][0] == '-')
+                exit_usage(1);
+            stream = 1;
+        }
+        else if (!strcmp(argv[i], "--pretty") || !strcmp(argv[i], "--minify")) {
+            if (so.format)
+                exit_usage(1);
+            so.format = argv[i][2] == 'p' ? JSON_PRETTY : JSON_MINIFY;
+            stream = 1;
+        }
+        else if (!strcmp(argv[i], "--select") && i + 1 < argc) {
+            so.select = argv[++i];
+            stream = 1;
+        }
+        else if (!strcmp(argv[i], "--raw"))
+            so.raw = 1;
+        else if ((!strcmp(argv[i], "--export") && i + 1 < argc) || !strncmp(argv[i], "--export=", 9)) {
+            const char *f = argv[i][8] ? argv[i] + 9 : argv[++i];
+            so.export = !strcmp(f, "tsv") ? JSON_EXPORT_TSV : !strcmp(f, "csv") ? JSON_EXPORT_CSV
+                        : !strcmp(f, "ndjson") ? JSON_EXPORT_NDJSON : !strcmp(f, "uri") ? JSON_EXPORT_URI : 0;
+            if (!so.export)
+                exit_usage(1);
+            stream = 1;
+        }
+        else if (!strcmp(argv[i], "--build-index"))
+            index = 1;
+        else if (!strcmp(argv[i], "--range") && i + 1 < argc) {
+            char *mid, *end;
+            roff = strtoul(argv[++i], &mid, 10);
+            if (*mid != ':' || mid == argv[i] || argv[i][0] == '-')
+                exit_usage(1);
+            rlen = strtoul(mid + 1, &end, 10);
+            if (*end || end == mid + 1 || mid[1] == '-')
+                exit_usage(1);
+            range = 1;
+        }
+        else if (!strcmp(argv[i], "--url-index") && i + 1 < argc)
+            urls = argv[++i];
+        else if (!strcmp(argv[i], "--url-lookup") && i + 1 < argc)
+            lookup = argv[++i];
+        else if (!strcmp(argv[i], "--grep") && i + 1 < argc && argv[i + 1][0])
+            so.grep = argv[++i];
+        else if (!strcmp(argv[i], "-l"))
+            so.files_only = 1;
+        else if (!strcmp(argv[i], "--info"))
+            info = 1;
+        else if (!strcmp(argv[i], "--json"))
+            json = 1;
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            if ((nthreads = atoi(argv[++i])) < 1)
+                exit_usage(1);
+        }
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            if ((parallel = atoi(argv[++i])) < 1)
+                exit_usage(1);
+        }
+        else if (!strcmp(argv[i], "--files-from") && i + 1 < argc)
+            list = argv[++i];
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            dir = argv[++i];
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            outdir = argv[++i];
+        else if (!strcmp(argv[i], "--")) {
+            i++;
+            break;
+        }
+        else
+            exit_usage(1);
+    }
+
+    if ((outdir && (!dir || info)) || (dir && i != argc) || (json && !info) || (so.format && info))
+        exit_usage(1);
+    if ((so.select && (so.format || info || !valid_path(so.select))) || (so.raw && !so.select))
+        exit_usage(1);
+    if (so.export && (so.format || so.select || info))
+        exit_usage(1);
+    if ((so.grep && (so.format || so.select || so.export || info || outdir)) || (so.files_only && !so.grep))
+        exit_usage(1);
+    if ((index || range) && (index + range + stream + info + (parallel > 1) > 1
+                             || nthreads || list || dir || urls || lookup || so.grep))
+        exit_usage(1);
+    if (index) {
+        if (argc - i != 1 || !strcmp("-", argv[i]))
+            exit_usage(1);
+        rv = build_index(argv[i], &ib, &ob);
+        free(ib.data);
+        free(ob.data);
+        return rv;
+    }
+    if ((urls || lookup) && ((urls && lookup) || stream || info || parallel > 1 || outdir || so.grep))
+        exit_usage(1);
+    if (lookup) {
+        if (argc - i != 1 || nthreads || list || dir)
+            exit_usage(1);
+        return url_lookup(lookup, argv[i]);
+    }
+    if (urls) {
+        urlidx_t u;
+        if (!list && !dir && i == argc)
+            exit_usage(1);
+        memset(&u, 0, sizeof u);
+        pthread_mutex_init(&u.lock, 0);
+        if (!(rv = urls_load(&u, urls))) {
+            rv = batch(argv + i, argc - i, list, dir, 0, nthreads ? nthreads : 1, MODE_URLS, &so, &u);
+            if (u.nomem || urls_save(&u, urls))
+                rv = 1;  /* the index is kept as it was */
+        }
+        urls_free(&u);
+        pthread_mutex_destroy(&u.lock);
+        return rv;
+    }
+    if (nthreads || list || dir || info || so.grep) {
+        if ((!list && !dir && i == argc) || parallel > 1)
+            exit_usage(1);
+        rv = batch(argv + i, argc - i, list, dir, outdir, nthreads ? nthreads : 1,
+                   info ? (json ? MODE_JSON : MODE_INFO) : so.grep ? MODE_GREP
+                   : stream ? MODE_STREAM : MODE_DECODE, &so, 0);
+        return rv || (so.grep && !grep_matched);
+    }
+
+    if (argc - i < 1 || argc - i > 2)
+        exit_usage(1);
+    if (strcmp("-", argv[i]))
+        iname = argv[i];
+    if (argc - i > 1 && strcmp("-", argv[i + 1]))
+        oname = argv[i + 1];
+
+    if ((stream && parallel > 1) || (range && !iname))
+        exit_usage(1);
+    if (range)
+        return range_file(iname, oname, roff, rlen);
+    if (stream)
+        return stream_file(iname, oname, &so);
 
+    rv = decompress_file(iname, oname, &ib, &ob, parallel);
+    free(ib.data);
+    free(ob.data);
     return rv;
 }
@@ -0,0 +1,1082 @@
+/*
+   json - Streaming JSON formatting for dejsonlz4
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+
+/*
+   The text is scanned for the few bytes which matter: outside of strings,
+   whitespace and the structural characters, and in strings, the closing quote
+   and backslash. Runs of other bytes are copied or skipped as a whole, and
+   strings, which are most of the text, are scanned 8 bytes at a time.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+#define STATE_TEXT    0
+#define STATE_STRING  1
+#define STATE_ESCAPE  2
+
+#define INDENT  2
+
+typedef unsigned long long U64;
+
+#define ONES   0x0101010101010101ULL
+#define HIGHS  0x8080808080808080ULL
+
+/* Non-zero if one of the 8 bytes of v is 0 */
+#define HAS_ZERO(v)  (((v) - ONES) & ~(v) & HIGHS)
+
+static void out_init(json_out_t *o, json_write_fn write, void *opaque)
+{
+    o->write = write;
+    o->opaque = opaque;
+    o->err = 0;
+    o->olen = 0;
+}
+
+static void flush(json_out_t *o)
+{
+    if (o->olen && !o->err)
+        o->err = o->write(o->opaque, o->obuf, o->olen) != 0;
+    o->olen = 0;
+}
+
+static void put(json_out_t *o, const unsigned char *p, size_t n)
+{
+    if (o->olen + n > sizeof o->obuf) {
+        flush(o);
+        if (n > sizeof o->obuf) {
+            if (!o->err)
+                o->err = o->write(o->opaque, p, n) != 0;
+            return;
+        }
+    }
+    memcpy(o->obuf + o->olen, p, n);
+    o->olen += n;
+}
+
+static void put_char(json_out_t *o, unsigned char c)
+{
+    if (o->olen == sizeof o->obuf)
+        flush(o);
+    o->obuf[o->olen++] = c;
+}
+
+/* Returns the first quote or backslash at p, or end */
+static const unsigned char *string_end(const unsigned char *p, const unsigned char *end)
+{
+    while (end - p >= 8) {
+        U64 v, q, b;
+        memcpy(&v, p, 8);
+        q = v ^ ('"' * ONES);
+        b = v ^ ('\\' * ONES);
+        if (HAS_ZERO(q) | HAS_ZERO(b))
+            break;
+        p += 8;
+    }
+    while (p < end && *p != '"' && *p != '\\')
+        p++;
+    return p;
+}
+
+static int is_space(unsigned char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static int is_structural(unsigned char c)
+{
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == ',' || c == ':';
+}
+
+/* Returns the end of the run of bytes at p which aren't whitespace, a quote,
+ * or (if structural) a structural character */
+static const unsigned char *run_end(const unsigned char *p, const unsigned char *end, int structural)
+{
+    if (structural) {
+        while (p < end && !is_space(*p) && *p != '"' && !is_structural(*p))
+            p++;
+    } else {
+        while (p < end && !is_space(*p) && *p != '"')
+            p++;
+    }
+    return p;
+}
+
+
+/***********************************************
+   Formatting
+***********************************************/
+
+static void newline(json_fmt_t *f)
+{
+    static const unsigned char spaces[] = "                                "
+                                          "                                ";
+    size_t n = f->depth * INDENT;
+    put_char(&f->out, '\n');
+    for (; n > sizeof spaces - 1; n -= sizeof spaces - 1)
+        put(&f->out, spaces, sizeof spaces - 1);
+    put(&f->out, spaces, n);
+}
+
+void json_fmt_init(json_fmt_t *f, int mode, json_write_fn write, void *opaque)
+{
+    f->mode = mode;
+    f->state = STATE_TEXT;
+    f->open = 0;
+    f->depth = 0;
+    out_init(&f->out, write, opaque);
+}
+
+int json_fmt_write(void *fmt, const void *buf, size_t size)
+{
+    json_fmt_t *f = fmt;
+    json_out_t *o = &f->out;
+    const unsigned char *p = buf, *end = p + size, *q;
+
+    while (p < end && !o->err) {
+        unsigned char c;
+
+        if (f->state == STATE_STRING) {
+            q = string_end(p, end);
+            put(o, p, q - p);
+            if ((p = q) == end)
+                break;
+            f->state = *p == '"' ? STATE_TEXT : STATE_ESCAPE;
+            put_char(o, *p++);
+            continue;
+        }
+        if (f->state == STATE_ESCAPE) {
+            f->state = STATE_STRING;
+            put_char(o, *p++);
+            continue;
+        }
+
+        c = *p;
+        if (is_space(c)) {
+            p++;
+            continue;
+        }
+        if (f->open) {
+            f->open = 0;
+            if (c == '}' || c == ']') {  /* empty */
+                f->depth--;
+                put_char(o, *p++);
+                continue;
+            }
+            newline(f);
+        }
+        if (c == '"') {
+            f->state = STATE_STRING;
+            put_char(o, *p++);
+            continue;
+        }
+        if (f->mode == JSON_PRETTY) {
+            switch (c) {
+            case '{': case '[':
+                put_char(o, *p++);
+                f->depth++;
+                f->open = 1;
+                continue;
+            case '}': case ']':
+                if (f->depth)
+                    f->depth--;
+                newline(f);
+                put_char(o, *p++);
+                continue;
+            case ',':
+                put_char(o, *p++);
+                newline(f);
+                continue;
+            case ':':
+                put(o, (const unsigned char *)": ", 2);
+                p++;
+                continue;
+            }
+        }
+        q = run_end(p, end, f->mode == JSON_PRETTY);
+        put(o, p, q - p);
+        p = q;
+    }
+    return o->err;
+}
+
+int json_fmt_end(json_fmt_t *f)
+{
+    if (f->mode == JSON_PRETTY)
+        put_char(&f->out, '\n');
+    flush(&f->out);
+    return f->out.err;
+}
+
+
+/***********************************************
+   Selection
+***********************************************/
+
+/*
+   The containers which the path entered are parsed, as far as the path goes
+   (depth of them). Other values are skipped, and the values at the end of the
+   path are written, while their nesting (vdepth) is tracked. A container which
+   ends without the member or element of its step (found) gives null, like jq,
+   and so does a null which the path continues into, unless the rest of the
+   path has [] (from null_depth on, it doesn't).
+*/
+#define STEP_KEY    0
+#define STEP_INDEX  1
+#define STEP_ALL    2
+
+/* nav: what's next in the innermost container which the path entered */
+#define NAV_VALUE   0   /* a value (or, in an array, its end) */
+#define NAV_KEY     1   /* a key (or the end) */
+#define NAV_KEYSTR  2   /* more of a key */
+#define NAV_COLON   3
+#define NAV_NEXT    4   /* a comma or the end */
+
+#define VALUE_NONE  0
+#define VALUE_SKIP  1
+#define VALUE_EMIT  2
+
+static int is_name(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+           || c == '_' || c == '$';
+}
+
+int json_sel_init(json_sel_t *s, const char *path, int raw, json_write_fn write, void *opaque)
+{
+    const char *p = path;
+    json_step_t *st;
+
+    memset(s, 0, sizeof *s - sizeof s->out);
+    s->raw = raw;
+    out_init(&s->out, write, opaque);
+
+    if (*p != '.')
+        return 1;
+    if (!p[1])
+        return 0;  /* the whole value */
+    while (*p) {
+        if (s->nsteps == JSON_SEL_MAX_STEPS)
+            return 1;
+        st = &s->steps[s->nsteps];
+        if (*p == '.' && p[1] == '[') {
+            p++;
+            continue;
+        }
+        if (*p == '.') {
+            st->type = STEP_KEY;
+            if (*++p == '"') {
+                st->key = ++p;
+                while (*p && *p != '"')
+                    p += *p == '\\' && p[1] ? 2 : 1;
+                if (!*p)
+                    return 1;
+                st->keylen = p++ - st->key;
+            } else {
+                st->key = p;
+                while (is_name(*p))
+                    p++;
+                if (!(st->keylen = p - st->key))
+                    return 1;
+            }
+        } else if (*p == '[') {
+            if (*++p == ']') {
+                st->type = STEP_ALL;
+            } else {
+                st->type = STEP_INDEX;
+                if (*p < '0' || *p > '9')
+                    return 1;
+                for (; *p >= '0' && *p <= '9'; p++)
+                    st->index = st->index * 10 + (*p - '0');
+                if (*p != ']')
+                    return 1;
+            }
+            p++;
+        } else {
+            return 1;
+        }
+        if (st->type == STEP_ALL)
+            s->null_depth = s->nsteps + 1;
+        s->nsteps++;
+    }
+    return 0;
+}
+
+/* After a value in the innermost container which the path entered */
+static void after_value(json_sel_t *s)
+{
+    if (!s->depth) {
+        s->nav = NAV_VALUE;  /* another top level value */
+        return;
+    }
+    s->count[s->depth - 1]++;
+    s->nav = NAV_NEXT;
+}
+
+static void value_end(json_sel_t *s)
+{
+    if (s->value == VALUE_EMIT)
+        put_char(&s->out, '\n');
+    s->value = VALUE_NONE;
+    after_value(s);
+}
+
+static void put_utf8(json_out_t *o, unsigned cp)
+{
+    unsigned char u[4];
+    size_t n;
+    if (cp < 0x80) {
+        u[0] = cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        u[0] = 0xc0 | cp >> 6;
+        u[1] = 0x80 | (cp & 0x3f);
+        n = 2;
+    } else if (cp < 0x10000) {
+        u[0] = 0xe0 | cp >> 12;
+        u[1] = 0x80 | (cp >> 6 & 0x3f);
+        u[2] = 0x80 | (cp & 0x3f);
+        n = 3;
+    } else {
+        u[0] = 0xf0 | cp >> 18;
+        u[1] = 0x80 | (cp >> 12 & 0x3f);
+        u[2] = 0x80 | (cp >> 6 & 0x3f);
+        u[3] = 0x80 | (cp & 0x3f);
+        n = 4;
+    }
+    put(o, u, n);
+}
+
+/* The value of 4 hex digits (invalid ones count as 0) */
+static unsigned hex4(const unsigned char *p)
+{
+    unsigned cp = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        unsigned char c = p[i] | 0x20;
+        cp = cp << 4 | (c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 0);
+    }
+    return cp;
+}
+
+/* Raw output: writes a high surrogate which isn't followed by a low one */
+static void put_lone_surrogate(json_sel_t *s)
+{
+    if (s->hi) {
+        put_utf8(&s->out, 0xfffd);
+        s->hi = 0;
+    }
+}
+
+/* Raw output: writes the escape after a backslash, once it's whole */
+static void put_escape(json_sel_t *s, unsigned char c)
+{
+    static const char from[] = "\"\\/bfnrt", to[] = "\"\\/\b\f\n\r\t";
+    const char *e;
+    unsigned cp;
+
+    s->esc[s->esc_len++] = c;
+    if (s->esc[0] == 'u' && s->esc_len < 5)
+        return;  /* more hex digits */
+    s->state = STATE_STRING;
+    s->esc_len = 0;
+
+    if (s->esc[0] != 'u') {
+        put_lone_surrogate(s);
+        e = strchr(from, s->esc[0]);
+        put_char(&s->out, e && *e ? to[e - from] : s->esc[0]);
+        return;
+    }
+    cp = hex4(s->esc + 1);
+    if (s->hi && cp >= 0xdc00 && cp < 0xe000) {
+        put_utf8(&s->out, 0x10000 + ((s->hi - 0xd800) << 10) + (cp - 0xdc00));
+        s->hi = 0;
+        return;
+    }
+    put_lone_surrogate(s);
+    if (cp >= 0xd800 && cp < 0xdc00)
+        s->hi = cp;
+    else
+        put_utf8(&s->out, cp >= 0xdc00 && cp < 0xe000 ? 0xfffd : cp);
+}
+
+/* Skips or writes the value at p, till it ends or till end. Returns the
+ * position after it */
+static const unsigned char *value_run(json_sel_t *s, const unsigned char *p, const unsigned char *end)
+{
+    json_out_t *o = s->value == VALUE_EMIT ? &s->out : 0;
+    int raw = o && s->raw && !s->vdepth;  /* a string at the top, unescaped */
+    const unsigned char *q;
+
+    while (p < end) {
+        unsigned char c = *p;
+
+        if (s->state == STATE_STRING) {
+            q = string_end(p, end);
+            if (o && q > p) {
+                if (raw)
+                    put_lone_surrogate(s);
+                put(o, p, q - p);
+            }
+            if ((p = q) == end)
+                break;
+            s->state = *p == '"' ? STATE_TEXT : STATE_ESCAPE;
+            if (o && !raw)
+                put_char(o, *p);
+            else if (raw && *p == '"')
+                put_lone_surrogate(s);
+            p++;
+            if (s->state == STATE_TEXT && !s->vdepth) {
+                value_end(s);
+                return p;
+            }
+            continue;
+        }
+        if (s->state == STATE_ESCAPE) {
+            if (raw) {
+                put_escape(s, c);
+            } else {
+                s->state = STATE_STRING;
+                if (o)
+                    put_char(o, c);
+            }
+            p++;
+            continue;
+        }
+
+        if (s->scalar) {
+            if (is_space(c) || is_structural(c)) {
+                value_end(s);  /* the delimiter is for the container */
+                return p;
+            }
+            q = run_end(p, end, 1);
+            if (o)
+                put(o, p, q - p);
+            p = q;
+            continue;
+        }
+        if (is_space(c)) {
+            p++;
+            continue;
+        }
+        if (c == '"') {
+            s->state = STATE_STRING;
+            if (o && !raw)
+                put_char(o, c);
+            p++;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            s->vdepth++;
+            raw = 0;
+        } else if (c == '}' || c == ']') {
+            if (!s->vdepth) {
+                s->bad = 1;
+                return end;
+            }
+            s->vdepth--;
+        } else if (c == ',' || c == ':') {
+            if (!s->vdepth) {
+                s->bad = 1;
+                return end;
+            }
+        } else {
+            if (!s->vdepth)
+                s->scalar = 1;
+            q = run_end(p, end, 1);
+            if (o)
+                put(o, p, q - p);
+            p = q;
+            continue;
+        }
+        if (o)
+            put_char(o, c);
+        p++;
+        if (!s->vdepth) {
+            value_end(s);
+            return p;
+        }
+        raw = o && s->raw && !s->vdepth;
+    }
+    return p;
+}
+
+static void value_start(json_sel_t *s, int mode)
+{
+    s->value = mode;
+    s->state = STATE_TEXT;
+    s->vdepth = 0;
+    s->scalar = 0;
+    s->esc_len = 0;
+    s->hi = 0;
+}
+
+int json_sel_write(void *sel, const void *buf, size_t size)
+{
+    json_sel_t *s = sel;
+    const unsigned char *p = buf, *end = p + size;
+
+    while (p < end && !s->out.err && !s->bad) {
+        const json_step_t *st = s->depth ? &s->steps[s->depth - 1] : 0;
+        unsigned char c;
+
+        if (s->value) {
+            p = value_run(s, p, end);
+            continue;
+        }
+
+        c = *p;
+        if (s->nav == NAV_KEYSTR) {
+            p++;
+            if (!s->kesc && c == '"') {
+                s->match = s->kpos == st->keylen;
+                s->nav = NAV_COLON;
+                continue;
+            }
+            s->kesc = !s->kesc && c == '\\';
+            if (s->kpos != (size_t)-1)
+                s->kpos = s->kpos < st->keylen && st->key[s->kpos] == c ? s->kpos + 1 : (size_t)-1;
+            continue;
+        }
+        if (is_space(c)) {
+            p++;
+            continue;
+        }
+        if ((c == '}' || c == ']') && s->depth && (s->nav == NAV_NEXT
+            || s->nav == (s->object[s->depth - 1] ? NAV_KEY : NAV_VALUE))) {
+            p++;
+            s->depth--;
+            if (!s->found[s->depth] && s->depth >= s->null_depth)
+                put(&s->out, (const unsigned char *)"null\n", 5);
+            after_value(s);
+            continue;
+        }
+
+        switch (s->nav) {
+        case NAV_VALUE:
+            if (st && st->type != STEP_KEY)
+                s->match = st->type == STEP_ALL || s->count[s->depth - 1] == st->index;
+            if (st && s->match)
+                s->found[s->depth - 1] = 1;
+            if (st && !s->match) {
+                value_start(s, VALUE_SKIP);
+            } else if (s->depth == s->nsteps) {
+                value_start(s, VALUE_EMIT);
+            } else if (c == (s->steps[s->depth].type == STEP_KEY ? '{' : '[')
+                       || (c == '{' && s->steps[s->depth].type == STEP_ALL)) {
+                p++;
+                s->count[s->depth] = 0;
+                s->found[s->depth] = 0;
+                s->object[s->depth] = c == '{';
+                s->nav = s->object[s->depth++] ? NAV_KEY : NAV_VALUE;
+            } else {
+                if (c == 'n' && s->depth >= s->null_depth)
+                    put(&s->out, (const unsigned char *)"null\n", 5);  /* null.key, null[N] */
+                value_start(s, VALUE_SKIP);
+            }
+            continue;
+        case NAV_KEY:
+            if (c != '"')
+                break;
+            p++;
+            s->kpos = 0;
+            s->kesc = 0;
+            s->nav = NAV_KEYSTR;
+            continue;
+        case NAV_COLON:
+            if (c != ':')
+                break;
+            p++;
+            s->nav = NAV_VALUE;
+            continue;
+        case NAV_NEXT:
+            if (c != ',')
+                break;
+            p++;
+            s->nav = s->object[s->depth - 1] ? NAV_KEY : NAV_VALUE;
+            continue;
+        }
+        s->bad = 1;
+    }
+    return s->out.err || s->bad;
+}
+
+int json_sel_end(json_sel_t *s)
+{
+    if (s->value == VALUE_EMIT && !s->bad)
+        put_char(&s->out, '\n');
+    flush(&s->out);
+    return s->out.err;
+}
+
+
+/***********************************************
+   Bookmarks Export
+***********************************************/
+
+/*
+   The objects and the children arrays are entered alternately, from the top
+   object (depth 1), so the innermost is an object if depth is odd. Kept values
+   are appended to fields as they are in the text (strings without the
+   quotes), and converted when the row is written, at the end of the object.
+*/
+#define VALUE_KEEP  3
+
+#define NAV_KEYESC  5   /* after a backslash in a key */
+
+#define FIELD_TITLE     0
+#define FIELD_URI       1
+#define FIELD_CHILDREN  JSON_EXP_FIELDS
+#define FIELD_OTHER     (JSON_EXP_FIELDS + 1)
+
+static const char *const field_names[] = {
+    "title", "uri", "dateAdded", "lastModified", "tags", "children"
+};
+
+#define IN_OBJECT(x)  ((x)->depth & 1)
+
+static void append(json_exp_t *x, json_buf_t *b, const void *p, size_t n)
+{
+    if (!n)
+        return;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap * 2 > b->len + n ? b->cap * 2 : b->len + n + 256;
+        unsigned char *data = realloc(b->data, cap);
+        if (!data) {
+            x->nomem = 1;
+            return;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+/* Writes the decoded character c of a string */
+static void put_text_char(json_exp_t *x, unsigned char c)
+{
+    json_out_t *o = &x->out;
+    if (x->format == JSON_EXPORT_CSV) {
+        if (c == '"')
+            put_char(o, c);
+    } else if (c == '\\' || c == '\t' || c == '\n' || c == '\r') {
+        put_char(o, '\\');
+        c = c == '\t' ? 't' : c == '\n' ? 'n' : c == '\r' ? 'r' : c;
+    }
+    put_char(o, c);
+}
+
+/* Writes the string p of n bytes (as in the text, without the quotes)
+ * decoded, for TSV or CSV */
+static void put_text(json_exp_t *x, const unsigned char *p, size_t n)
+{
+    static const char from[] = "\"\\/bfnrt", to[] = "\"\\/\b\f\n\r\t";
+    const unsigned char *end = p + n, *q;
+    const char *e;
+    unsigned cp;
+
+    while (p < end) {
+        q = x->format == JSON_EXPORT_CSV ? string_end(p, end) : p;
+        while (q < end && *q != '\\' && *q != '\t' && *q != '\n' && *q != '\r')
+            q++;  /* for TSV, control characters aren't valid in strings anyway */
+        put(&x->out, p, q - p);
+        if ((p = q) == end)
+            break;
+        if (*p != '\\' || end - p < 2) {
+            put_text_char(x, *p++);
+            continue;
+        }
+        if (p[1] != 'u' || end - p < 6) {
+            e = strchr(from, p[1]);
+            put_text_char(x, e && *e ? to[e - from] : p[1]);
+            p += 2;
+            continue;
+        }
+        cp = hex4(p + 2);
+        p += 6;
+        if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+            unsigned lo = hex4(p + 2);
+            if (lo >= 0xdc00 && lo < 0xe000) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                p += 6;
+            }
+        }
+        if (cp < 0x80)
+            put_text_char(x, cp);
+        else
+            put_utf8(&x->out, cp >= 0xd800 && cp < 0xe000 ? 0xfffd : cp);
+    }
+}
+
+/* Writes a value of the row: the path if f is -1, or a field */
+static void put_value(json_exp_t *x, int f)
+{
+    json_out_t *o = &x->out;
+    static const unsigned char none[1];
+    const unsigned char *p = f < 0 ? x->path.data : x->fields.data + x->start[f];
+    size_t n = f < 0 ? x->path.len : x->end[f] - x->start[f];
+    int string = f < 0 || x->string >> f & 1;
+
+    if (!p)
+        p = none;  /* nothing was kept yet */
+
+    if (f >= 0 && !(x->have >> f & 1)) {
+        if (x->format == JSON_EXPORT_NDJSON)
+            put(o, (const unsigned char *)"null", 4);
+    } else if (!string) {
+        put(o, p, n);
+    } else if (x->format == JSON_EXPORT_NDJSON) {
+        put_char(o, '"');
+        put(o, p, n);
+        put_char(o, '"');
+    } else if (x->format == JSON_EXPORT_CSV) {
+        put_char(o, '"');
+        put_text(x, p, n);
+        put_char(o, '"');
+    } else {
+        put_text(x, p, n);
+    }
+}
+
+static void put_row(json_exp_t *x)
+{
+    json_out_t *o = &x->out;
+    int f;
+
+    if (x->format == JSON_EXPORT_URI) {
+        put_value(x, FIELD_URI);
+        put_char(o, '\n');
+        return;
+    }
+    if (x->format == JSON_EXPORT_NDJSON)
+        put(o, (const unsigned char *)"{\"path\":", 8);
+    put_value(x, -1);
+    for (f = 0; f < JSON_EXP_FIELDS; f++) {
+        if (x->format == JSON_EXPORT_NDJSON) {
+            put_char(o, ',');
+            put_char(o, '"');
+            put(o, (const unsigned char *)field_names[f], strlen(field_names[f]));
+            put_char(o, '"');
+            put_char(o, ':');
+        } else {
+            put_char(o, x->format == JSON_EXPORT_CSV ? ',' : '\t');
+        }
+        put_value(x, f);
+    }
+    if (x->format == JSON_EXPORT_NDJSON)
+        put_char(o, '}');
+    put_char(o, '\n');
+}
+
+void json_exp_init(json_exp_t *x, int format, json_write_fn write, void *opaque)
+{
+    int f;
+
+    memset(x, 0, sizeof *x - sizeof x->out);
+    x->format = format;
+    out_init(&x->out, write, opaque);
+
+    if (format == JSON_EXPORT_NDJSON || format == JSON_EXPORT_URI)
+        return;
+    put(&x->out, (const unsigned char *)"path", 4);
+    for (f = 0; f < JSON_EXP_FIELDS; f++) {
+        put_char(&x->out, format == JSON_EXPORT_CSV ? ',' : '\t');
+        put(&x->out, (const unsigned char *)field_names[f], strlen(field_names[f]));
+    }
+    put_char(&x->out, '\n');
+}
+
+/* After a value in the innermost object or children array */
+static void exp_after_value(json_exp_t *x)
+{
+    x->nav = x->depth ? NAV_NEXT : NAV_VALUE;
+}
+
+static void exp_value_start(json_exp_t *x, int mode)
+{
+    x->value = mode;
+    x->state = STATE_TEXT;
+    x->vdepth = 0;
+    x->scalar = 0;
+    if (mode == VALUE_KEEP) {
+        x->start[x->field] = x->fields.len;
+        x->have &= ~(1u << x->field);
+        x->string &= ~(1u << x->field);
+    }
+}
+
+static void exp_value_end(json_exp_t *x)
+{
+    if (x->value == VALUE_KEEP) {
+        x->end[x->field] = x->fields.len;
+        x->have |= 1u << x->field;
+    }
+    x->value = VALUE_NONE;
+    exp_after_value(x);
+}
+
+/* Skips or keeps the value at p, till it ends or till end. Returns the
+ * position after it */
+static const unsigned char *exp_value_run(json_exp_t *x, const unsigned char *p, const unsigned char *end)
+{
+    json_buf_t *b = x->value == VALUE_KEEP ? &x->fields : 0;  /* only scalars are kept */
+    const unsigned char *q;
+
+    while (p < end) {
+        unsigned char c = *p;
+
+        if (x->state == STATE_STRING) {
+            q = string_end(p, end);
+            if (b)
+                append(x, b, p, q - p);
+            if ((p = q) == end)
+                break;
+            x->state = *p == '"' ? STATE_TEXT : STATE_ESCAPE;
+            if (b && *p == '\\')
+                append(x, b, p, 1);
+            p++;
+            if (x->state == STATE_TEXT && !x->vdepth) {
+                exp_value_end(x);
+                return p;
+            }
+            continue;
+        }
+        if (x->state == STATE_ESCAPE) {
+            x->state = STATE_STRING;
+            if (b)
+                append(x, b, p, 1);
+            p++;
+            continue;
+        }
+
+        if (x->scalar) {
+            if (is_space(c) || is_structural(c) || c == '"') {
+                exp_value_end(x);  /* the delimiter is for the container */
+                return p;
+            }
+            q = run_end(p, end, 1);
+            if (b)
+                append(x, b, p, q - p);
+            p = q;
+            continue;
+        }
+        if (is_space(c)) {
+            p++;
+            continue;
+        }
+        if (c == '"') {
+            x->state = STATE_STRING;
+            if (b)
+                x->string |= 1u << x->field;
+            p++;
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            x->vdepth++;
+        } else if (c == '}' || c == ']') {
+            if (!x->vdepth) {
+                x->bad = 1;
+                return end;
+            }
+            x->vdepth--;
+        } else if (c == ',' || c == ':') {
+            if (!x->vdepth) {
+                x->bad = 1;
+                return end;
+            }
+        } else {
+            if (!x->vdepth)
+                x->scalar = 1;
+            q = run_end(p, end, 1);
+            if (b)
+                append(x, b, p, q - p);
+            p = q;
+            continue;
+        }
+        p++;
+        if (!x->vdepth) {
+            exp_value_end(x);
+            return p;
+        }
+    }
+    return p;
+}
+
+static int field_of(const json_exp_t *x)
+{
+    int f;
+    for (f = 0; f <= FIELD_CHILDREN; f++) {
+        if (x->klen == strlen(field_names[f]) && !memcmp(x->key, field_names[f], x->klen))
+            return f;
+    }
+    return FIELD_OTHER;
+}
+
+/* Enters a children array of the current object. If it's also a bookmark,
+ * its row is written now, since the children replace its fields */
+static void enter_folder(json_exp_t *x)
+{
+    if (!x->folder && x->have >> FIELD_URI & 1)
+        put_row(x);
+    append(x, &x->levels, &x->path.len, sizeof x->path.len);
+    if (x->depth == 1)
+        return;  /* the top object isn't in the path */
+    append(x, &x->path, "/", 1);
+    if ((x->have & x->string) >> FIELD_TITLE & 1)
+        append(x, &x->path, x->fields.data + x->start[FIELD_TITLE],
+               x->end[FIELD_TITLE] - x->start[FIELD_TITLE]);
+}
+
+static void leave_folder(json_exp_t *x)
+{
+    x->levels.len -= sizeof x->path.len;
+    memcpy(&x->path.len, x->levels.data + x->levels.len, sizeof x->path.len);
+    x->folder = 1;
+}
+
+int json_exp_write(void *exp, const void *buf, size_t size)
+{
+    json_exp_t *x = exp;
+    const unsigned char *p = buf, *end = p + size;
+
+    while (p < end && !x->out.err && !x->bad && !x->nomem) {
+        unsigned char c;
+
+        if (x->value) {
+            p = exp_value_run(x, p, end);
+            continue;
+        }
+
+        c = *p;
+        if (x->nav == NAV_KEYESC) {
+            p++;
+            x->nav = NAV_KEYSTR;
+            continue;
+        }
+        if (x->nav == NAV_KEYSTR) {
+            const unsigned char *q = string_end(p, end);
+            size_t n = q - p;
+            if (x->klen < sizeof x->key)
+                memcpy(x->key + x->klen, p, n < sizeof x->key - x->klen ? n : sizeof x->key - x->klen);
+            x->klen += n;  /* if it's longer than key, it's none of the fields */
+            if ((p = q) == end)
+                break;
+            p++;
+            if (p[-1] == '\\') {
+                x->klen = sizeof x->key + 1;  /* escaped: none of the fields */
+                x->nav = NAV_KEYESC;
+                continue;
+            }
+            x->field = field_of(x);
+            x->nav = NAV_COLON;
+            continue;
+        }
+        if (is_space(c)) {
+            p++;
+            continue;
+        }
+        if ((c == '}' || c == ']') && x->depth
+            && (x->nav == NAV_NEXT || x->nav == (IN_OBJECT(x) ? NAV_KEY : NAV_VALUE))) {
+            p++;
+            if (IN_OBJECT(x)) {
+                if (!x->folder && x->have >> FIELD_URI & 1)
+                    put_row(x);
+                x->depth--;
+            } else {
+                x->depth--;
+                leave_folder(x);
+            }
+            exp_after_value(x);
+            continue;
+        }
+
+        switch (x->nav) {
+        case NAV_VALUE:
+            if (!IN_OBJECT(x) && c == '{') {
+                p++;
+                x->depth++;
+                x->folder = 0;
+                x->have = 0;
+                x->fields.len = 0;
+                x->nav = NAV_KEY;
+            } else if (IN_OBJECT(x) && x->field == FIELD_CHILDREN && c == '[') {
+                p++;
+                enter_folder(x);
+                x->depth++;
+                x->nav = NAV_VALUE;
+            } else {
+                exp_value_start(x, IN_OBJECT(x) && x->field < JSON_EXP_FIELDS
+                                   && c != '{' && c != '[' ? VALUE_KEEP : VALUE_SKIP);
+            }
+            continue;
+        case NAV_KEY:
+            if (c != '"')
+                break;
+            p++;
+            x->klen = 0;
+            x->nav = NAV_KEYSTR;
+            continue;
+        case NAV_COLON:
+            if (c != ':')
+                break;
+            p++;
+            x->nav = NAV_VALUE;
+            continue;
+        case NAV_NEXT:
+            if (c != ',')
+                break;
+            p++;
+            x->nav = IN_OBJECT(x) ? NAV_KEY : NAV_VALUE;
+            continue;
+        }
+        x->bad = 1;
+    }
+    return x->out.err || x->bad || x->nomem;
+}
+
+int json_exp_end(json_exp_t *x)
+{
+    flush(&x->out);
+    return x->out.err;
+}
+
+void json_exp_free(json_exp_t *x)
+{
+    free(x->fields.data);
+    free(x->path.data);
+    free(x->levels.data);
+    x->fields.data = x->path.data = x->levels.data = 0;
+    x->fields.cap = x->path.cap = x->levels.cap = 0;
+}
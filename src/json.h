@@ -0,0 +1,314 @@
+/*
+   json - Streaming JSON formatting for dejsonlz4
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+#pragma once
+
+#include <stddef.h>
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+
+/*
+    JSON text which arrives in chunks of any size, such as the output of
+    mozlz4_stream_decode(), is reformatted or filtered as it arrives, and the
+    result is written using a callback, in chunks of up to JSON_OUT_SIZE bytes.
+    The memory use is fixed, regardless of the size of the text or of the
+    values in it (except for the exporter, which keeps one object at a time).
+*/
+
+#define JSON_OUT_SIZE  (64 * 1024)
+
+/* writes size bytes from buf. return : 0 to continue, or non-zero to stop */
+typedef int (*json_write_fn)(void *opaque, const void *buf, size_t size);
+
+/* The output buffer. All the fields are private */
+typedef struct {
+    json_write_fn write;
+    void *opaque;
+    int err;        /* the write callback failed */
+    size_t olen;
+    unsigned char obuf[JSON_OUT_SIZE];
+} json_out_t;
+
+
+/***********************************************
+   Formatting
+***********************************************/
+
+/*
+    The formatter tracks strings and nesting only, and doesn't validate: other
+    text is passed through with whitespace changes only.
+
+    JSON_MINIFY : removes all the whitespace outside of strings.
+    JSON_PRETTY : one value or member per line, indented by 2 spaces per
+                  level, with ": " after keys, and a newline at the end.
+*/
+#define JSON_MINIFY  1
+#define JSON_PRETTY  2
+
+/*
+ * json_fmt_t
+ * The caller provides the memory (about 64K) and initializes it using
+ * json_fmt_init(). All the fields are private.
+ */
+typedef struct {
+    int mode;
+    int state;      /* outside of strings, in a string, or after a backslash */
+    int open;       /* JSON_PRETTY: after { or [, before the newline */
+    size_t depth;
+    json_out_t out;
+} json_fmt_t;
+
+/*
+ * json_fmt_init
+ * Prepares f to format text in mode (JSON_MINIFY or JSON_PRETTY), which is
+ * written using write(opaque, ...).
+ */
+void json_fmt_init(json_fmt_t *f, int mode, json_write_fn write, void *opaque);
+
+/*
+ * json_fmt_write
+ * Formats the next size bytes of text from buf. It has the signature of a
+ * write callback (json_write_fn, mozlz4_write_fn), with f as its opaque.
+ * Return : 0, or non-zero if the write callback failed.
+ */
+int json_fmt_write(void *f, const void *buf, size_t size);
+
+/*
+ * json_fmt_end
+ * Ends the text, and writes what's still buffered.
+ * Return : 0, or non-zero if the write callback failed.
+ */
+int json_fmt_end(json_fmt_t *f);
+
+
+/***********************************************
+   Selection
+***********************************************/
+
+/*
+    The selector writes the values at a path, one per line, without the
+    whitespace outside of their strings (or, for raw output of a string, its
+    unescaped content). The path is a subset of jq's:
+
+        .          the whole value
+        .key       a member of an object (letters, digits, '_' and '$'),
+        ."key"     or any key, as it's written in the JSON text (escaped)
+        []         each element of an array, or value of an object (also .[])
+        [N]        the element N of an array (from 0)
+
+    e.g. '.children[].children[].uri'. Values which don't match are skipped
+    without being kept anywhere. Objects and arrays which the path enters are
+    only checked as far as the path needs, and the JSON text isn't validated
+    beyond that.
+
+    As in jq, an object which the path enters without the key, or an array
+    without the element N, gives null (once it ends), e.g. for each bookmark
+    without a uri above, and so does null followed by more of the path. Where
+    jq fails, nothing is written: when the rest of the path has [] (jq can't
+    iterate over null), and for the other values of the wrong type (other
+    than objects for .key, arrays for [N], and both for []).
+*/
+#define JSON_SEL_MAX_STEPS  32
+
+typedef struct {
+    int type;
+    const char *key;    /* in the path string */
+    size_t keylen;
+    size_t index;
+} json_step_t;
+
+/*
+ * json_sel_t
+ * The caller provides the memory (about 64K) and initializes it using
+ * json_sel_init(). Only bad may be read directly, the rest is private.
+ */
+typedef struct {
+    int bad;            /* the text isn't JSON */
+
+    json_step_t steps[JSON_SEL_MAX_STEPS];
+    int nsteps;
+    int raw;
+    int nav;            /* what's next in the containers which the path entered */
+    int depth;          /* the number of these containers */
+    size_t count[JSON_SEL_MAX_STEPS];  /* elements in each */
+    int found[JSON_SEL_MAX_STEPS];     /* whether each has its step's member or element */
+    int object[JSON_SEL_MAX_STEPS];    /* whether each is an object */
+    int null_depth;     /* containers from this depth give null without it */
+    int match;          /* the current member matches the path */
+    size_t kpos;        /* of the key being compared, or -1 if it doesn't match */
+    int kesc;
+    int value;          /* a value is being skipped or written */
+    int state;          /* in it: outside of strings, in a string, or after a backslash */
+    size_t vdepth;
+    int scalar;
+    unsigned char esc[5];  /* raw output: the escape after a backslash */
+    int esc_len;
+    unsigned hi;        /* and a high surrogate before it */
+    json_out_t out;
+} json_sel_t;
+
+/*
+ * json_sel_init
+ * Prepares s to write the values at path (which must remain valid) using
+ * write(opaque, ...), and if raw, strings are written unescaped.
+ * Return : 0, or non-zero if the path is invalid.
+ */
+int json_sel_init(json_sel_t *s, const char *path, int raw, json_write_fn write, void *opaque);
+
+/*
+ * json_sel_write
+ * Reads the next size bytes of text from buf. It has the signature of a
+ * write callback (json_write_fn, mozlz4_write_fn), with s as its opaque.
+ * Return : 0, or non-zero if the write callback failed or the text isn't
+ *          JSON (then s->bad is set).
+ */
+int json_sel_write(void *s, const void *buf, size_t size);
+
+/*
+ * json_sel_end
+ * Ends the text, and writes what's still buffered. A value which the text
+ * ends in the middle of (other than a number or a literal) is written as far
+ * as it goes, with a newline.
+ * Return : 0, or non-zero if the write callback failed.
+ */
+int json_sel_end(json_sel_t *s);
+
+
+/***********************************************
+   Bookmarks Export
+***********************************************/
+
+/*
+    The exporter walks a bookmarks backup, where each object (a folder, a
+    bookmark or a separator) may have a "children" array of such objects, and
+    writes a row for each bookmark (an object with a "uri"):
+
+        path, title, uri, dateAdded, lastModified, tags
+
+    The path is the titles of the folders which contain it below the top
+    level object, each after a '/' (e.g. "/toolbar/News"). The title of a
+    folder is only known if it comes before "children" (as Firefox writes it).
+    Likewise, the row of a bookmark which also has "children" is written when
+    they start, with the members before them.
+
+    JSON_EXPORT_TSV : a header line, and then values separated by tabs, where
+                      a backslash, tab, newline or CR is written as \\, \t, \n
+                      or \r.
+    JSON_EXPORT_CSV : a header line, and then values separated by commas
+                      (RFC 4180), where strings are quoted.
+    JSON_EXPORT_NDJSON : an object with these members per line, where strings
+                      are as in the text. A missing value is null.
+    JSON_EXPORT_URI : the uri alone per line, escaped as with TSV.
+
+    Other members and values are skipped as with the selector, but the path
+    and the members of the current object are kept, using memory which is
+    allocated as needed, so json_exp_free() must be called at the end.
+*/
+#define JSON_EXPORT_TSV     1
+#define JSON_EXPORT_CSV     2
+#define JSON_EXPORT_NDJSON  3
+#define JSON_EXPORT_URI     4
+
+#define JSON_EXP_FIELDS  5  /* title, uri, dateAdded, lastModified, tags */
+
+/* Allocated memory. All the fields are private */
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+} json_buf_t;
+
+/*
+ * json_exp_t
+ * The caller provides the memory (about 64K) and initializes it using
+ * json_exp_init(). Only bad and nomem may be read directly, the rest is
+ * private.
+ */
+typedef struct {
+    int bad;            /* the text isn't JSON */
+    int nomem;          /* memory allocation failed */
+
+    int format;
+    int nav;            /* what's next in the innermost object or children array */
+    size_t depth;       /* the number of these, alternately, from the top object */
+    int folder;         /* the current object had children */
+    unsigned char key[16];  /* the start of the current key */
+    size_t klen;
+    int field;          /* which the key is */
+    int value;          /* a value is being skipped or kept */
+    int state;          /* in it: outside of strings, in a string, or after a backslash */
+    size_t vdepth;
+    int scalar;
+    unsigned have, string;  /* bits of the kept fields, and of those which are strings */
+    size_t start[JSON_EXP_FIELDS], end[JSON_EXP_FIELDS];  /* in fields */
+    json_buf_t fields;  /* the kept values of the current object, as in the text */
+    json_buf_t path;    /* as in the text */
+    json_buf_t levels;  /* the path length before each folder */
+    json_out_t out;
+} json_exp_t;
+
+/*
+ * json_exp_init
+ * Prepares x to export rows in format (a JSON_EXPORT_* value), which are
+ * written using write(opaque, ...).
+ */
+void json_exp_init(json_exp_t *x, int format, json_write_fn write, void *opaque);
+
+/*
+ * json_exp_write
+ * Reads the next size bytes of text from buf. It has the signature of a
+ * write callback (json_write_fn, mozlz4_write_fn), with x as its opaque.
+ * Return : 0, or non-zero if the write callback failed, memory allocation
+ *          failed (then x->nomem is set) or the text isn't JSON (then x->bad
+ *          is set).
+ */
+int json_exp_write(void *x, const void *buf, size_t size);
+
+/*
+ * json_exp_end
+ * Ends the text, and writes what's still buffered. A row which the text ends
+ * in the middle of isn't written.
+ * Return : 0, or non-zero if the write callback failed.
+ */
+int json_exp_end(json_exp_t *x);
+
+/*
+ * json_exp_free
+ * Frees the memory which x allocated. It can be called at any time after
+ * json_exp_init(), and then x can be initialized again.
+ */
+void json_exp_free(json_exp_t *x);
+
+#if defined (__cplusplus)
+}
+#endif
@@ -293,6 +293,63 @@ typedef enum { full = 0, partial = 1 } earlyEnd_directive;
 #  define LZ4_WILDCOPY(d,s,e)   { if (likely(e-d <= 8)) LZ4_COPY8(d,s) else do { LZ4_COPY8(d,s) } while (d<e); }
 #endif
 
+/*
+ * 16 bytes copies, using SSE2 or NEON registers where available (both are part of
+ * the x86-64 and AArch64 baselines), otherwise a fixed size memcpy which compilers
+ * turn into the widest moves they can.
+ * LZ4_WILDCOPY16 may write (and read) up to 15 bytes beyond e.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define LZ4_COPY16(d,s)       _mm_storeu_si128((__m128i*)(d), _mm_loadu_si128((const __m128i*)(s)))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define LZ4_COPY16(d,s)       vst1q_u8((uint8_t*)(d), vld1q_u8((const uint8_t*)(s)))
+#else
+#  define LZ4_COPY16(d,s)       memcpy((d), (s), 16)
+#endif
+#define LZ4_WILDCOPY16(d,s,e)   { do { LZ4_COPY16(d,s); d+=16; s+=16; } while (d<e); }   /* at the end, d>=e; */
+
+/*
+ * Short offsets (2 to 15) : LZ4_PATTERN16 writes the first 16 bytes of the repeated
+ * pattern at d, which starts at s, with one byte shuffle (SSSE3, or NEON on AArch64).
+ * From there, each 16 bytes copy goes LZ4_patternStep[offset] bytes (a multiple of
+ * the offset) further, so it reads only final bytes.
+ * LZ4_PATTERN16 reads (and ignores) the 16-offset bytes after d.
+ */
+static const BYTE LZ4_patternStep[16] = { 16, 16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15 };
+
+#if defined(__SSSE3__) || (defined(__aarch64__) && defined(__ARM_NEON))
+static const BYTE LZ4_patternTable[16][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,15},
+    { 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1},
+    { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+    { 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
+    { 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0},
+    { 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3},
+    { 0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10, 0, 1, 2, 3, 4},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11, 0, 1, 2, 3},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12, 0, 1, 2},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13, 0, 1},
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14, 0},
+};
+#endif
+
+#if defined(__SSSE3__)
+#  include <tmmintrin.h>
+#  define LZ4_PATTERN16(d,s,off) _mm_storeu_si128((__m128i*)(d), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(s)), \
+                                     _mm_loadu_si128((const __m128i*)LZ4_patternTable[off])))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#  define LZ4_PATTERN16(d,s,off) vst1q_u8((uint8_t*)(d), vqtbl1q_u8(vld1q_u8((const uint8_t*)(s)), LZ4_patternTable[off]))
+#else
+#  define LZ4_PATTERN16(d,s,off) { size_t i_; for (i_ = 0; i_ < 16; i_++) (d)[i_] = (s)[i_]; }   /* byte by byte, so it repeats */
+#endif
+
 
 /****************************
    Private local functions
@@ -368,15 +425,15 @@ int LZ4_NbCommonBytes (register U32 val)
 ********************************/
 int LZ4_compressBound(int isize)  { return LZ4_COMPRESSBOUND(isize); }
 
-static int LZ4_hashSequence(U32 sequence, tableType_t tableType)
+static int LZ4_hashSequence(U32 sequence, tableType_t tableType, U32 hashLog)
 {
     if (tableType == byU16)
-        return (((sequence) * 2654435761U) >> ((MINMATCH*8)-(LZ4_HASHLOG+1)));
+        return (((sequence) * 2654435761U) >> ((MINMATCH*8)-(hashLog+1)));
     else
-        return (((sequence) * 2654435761U) >> ((MINMATCH*8)-LZ4_HASHLOG));
+        return (((sequence) * 2654435761U) >> ((MINMATCH*8)-hashLog));
 }
 
-static int LZ4_hashPosition(const BYTE* p, tableType_t tableType) { return LZ4_hashSequence(A32(p), tableType); }
+static int LZ4_hashPosition(const BYTE* p, tableType_t tableType, U32 hashLog) { return LZ4_hashSequence(A32(p), tableType, hashLog); }
 
 static void LZ4_putPositionOnHash(const BYTE* p, U32 h, void* tableBase, tableType_t tableType, const BYTE* srcBase)
 {
@@ -388,9 +445,9 @@ static void LZ4_putPositionOnHash(const BYTE* p, U32 h, void* tableBase, tableTy
     }
 }
 
-static void LZ4_putPosition(const BYTE* p, void* tableBase, tableType_t tableType, const BYTE* srcBase)
+static void LZ4_putPosition(const BYTE* p, void* tableBase, tableType_t tableType, U32 hashLog, const BYTE* srcBase)
 {
-    U32 h = LZ4_hashPosition(p, tableType);
+    U32 h = LZ4_hashPosition(p, tableType, hashLog);
     LZ4_putPositionOnHash(p, h, tableBase, tableType, srcBase);
 }
 
@@ -401,9 +458,9 @@ static const BYTE* LZ4_getPositionOnHash(U32 h, void* tableBase, tableType_t tab
     { U16* hashTable = (U16*) tableBase; return hashTable[h] + srcBase; }   /* default, to ensure a return */
 }
 
-static const BYTE* LZ4_getPosition(const BYTE* p, void* tableBase, tableType_t tableType, const BYTE* srcBase)
+static const BYTE* LZ4_getPosition(const BYTE* p, void* tableBase, tableType_t tableType, U32 hashLog, const BYTE* srcBase)
 {
-    U32 h = LZ4_hashPosition(p, tableType);
+    U32 h = LZ4_hashPosition(p, tableType, hashLog);
     return LZ4_getPositionOnHash(h, tableBase, tableType, srcBase);
 }
 
@@ -426,8 +483,15 @@ static unsigned LZ4_count(const BYTE* pIn, const BYTE* pRef, const BYTE* pInLimi
 }
 
 
-static int LZ4_compress_generic(
-                 void* ctx,
+/* dictionary, dictSize and currentOffset are the dictionary state (of a stream,
+ * or 0 with noDict), and table the hash table of 2^hashLog U32. acceleration 1
+ * is the normal search, and larger values make it skip ahead faster where it
+ * doesn't find matches */
+FORCE_INLINE int LZ4_compress_generic(
+                 const BYTE* dictionary,
+                 U32 dictSize,
+                 U32 currentOffset,
+                 void* table,
                  const char* source,
                  char* dest,
                  int inputSize,
@@ -436,16 +500,15 @@ static int LZ4_compress_generic(
                  limitedOutput_directive outputLimited,
                  tableType_t tableType,
                  dict_directive dict,
-                 dictIssue_directive dictIssue)
+                 dictIssue_directive dictIssue,
+                 U32 hashLog,
+                 U32 acceleration)
 {
-    LZ4_stream_t_internal* const dictPtr = (LZ4_stream_t_internal*)ctx;
-
     const BYTE* ip = (const BYTE*) source;
     const BYTE* base;
     const BYTE* lowLimit;
-    const BYTE* const lowRefLimit = ip - dictPtr->dictSize;
-    const BYTE* const dictionary = dictPtr->dictionary;
-    const BYTE* const dictEnd = dictionary + dictPtr->dictSize;
+    const BYTE* const lowRefLimit = ip - dictSize;
+    const BYTE* const dictEnd = dictionary + dictSize;
     const size_t dictDelta = dictEnd - (const BYTE*)source;
     const BYTE* anchor = (const BYTE*) source;
     const BYTE* const iend = ip + inputSize;
@@ -469,11 +532,11 @@ static int LZ4_compress_generic(
         lowLimit = (const BYTE*)source;
         break;
     case withPrefix64k:
-        base = (const BYTE*)source - dictPtr->currentOffset;
-        lowLimit = (const BYTE*)source - dictPtr->dictSize;
+        base = (const BYTE*)source - currentOffset;
+        lowLimit = (const BYTE*)source - dictSize;
         break;
     case usingExtDict:
-        base = (const BYTE*)source - dictPtr->currentOffset;
+        base = (const BYTE*)source - currentOffset;
         lowLimit = (const BYTE*)source;
         break;
     }
@@ -481,8 +544,8 @@ static int LZ4_compress_generic(
     if (inputSize<LZ4_minLength) goto _last_literals;                       /* Input too small, no compression (all literals) */
 
     /* First Byte */
-    LZ4_putPosition(ip, ctx, tableType, base);
-    ip++; forwardH = LZ4_hashPosition(ip, tableType);
+    LZ4_putPosition(ip, table, tableType, hashLog, base);
+    ip++; forwardH = LZ4_hashPosition(ip, tableType, hashLog);
 
     /* Main Loop */
     for ( ; ; )
@@ -492,7 +555,7 @@ static int LZ4_compress_generic(
         {
             const BYTE* forwardIp = ip;
             unsigned step=1;
-            unsigned searchMatchNb = (1U << skipStrength);
+            unsigned searchMatchNb = (acceleration << skipStrength);
 
             /* Find a match */
             do {
@@ -504,7 +567,7 @@ static int LZ4_compress_generic(
 
                 if (unlikely(forwardIp > mflimit)) goto _last_literals;
 
-                ref = LZ4_getPositionOnHash(h, ctx, tableType, base);
+                ref = LZ4_getPositionOnHash(h, table, tableType, base);
                 if (dict==usingExtDict)
                 {
                     if (ref<(const BYTE*)source)
@@ -518,8 +581,8 @@ static int LZ4_compress_generic(
                         lowLimit = (const BYTE*)source;
                     }
                 }
-                forwardH = LZ4_hashPosition(forwardIp, tableType);
-                LZ4_putPositionOnHash(ip, h, ctx, tableType, base);
+                forwardH = LZ4_hashPosition(forwardIp, tableType, hashLog);
+                LZ4_putPositionOnHash(ip, h, table, tableType, base);
 
             } while ( ((dictIssue==dictSmall) ? (ref < lowRefLimit) : 0)
                 || ((tableType==byU16) ? 0 : (ref + MAX_DISTANCE < ip))
@@ -596,10 +659,10 @@ _next_match:
         if (ip > mflimit) break;
 
         /* Fill table */
-        LZ4_putPosition(ip-2, ctx, tableType, base);
+        LZ4_putPosition(ip-2, table, tableType, hashLog, base);
 
         /* Test next position */
-        ref = LZ4_getPosition(ip, ctx, tableType, base);
+        ref = LZ4_getPosition(ip, table, tableType, hashLog, base);
         if (dict==usingExtDict)
         {
             if (ref<(const BYTE*)source)
@@ -613,14 +676,14 @@ _next_match:
                 lowLimit = (const BYTE*)source;
             }
         }
-        LZ4_putPosition(ip, ctx, tableType, base);
+        LZ4_putPosition(ip, table, tableType, hashLog, base);
         if ( ((dictIssue==dictSmall) ? (ref>=lowRefLimit) : 1)
             && (ref+MAX_DISTANCE>=ip)
             && (A32(ref+refDelta)==A32(ip)) )
         { token=op++; *token=0; goto _next_match; }
 
         /* Prepare next loop */
-        forwardH = LZ4_hashPosition(++ip, tableType);
+        forwardH = LZ4_hashPosition(++ip, tableType, hashLog);
     }
 
 _last_literals:
@@ -650,9 +713,9 @@ int LZ4_compress(const char* source, char* dest, int inputSize)
     int result;
 
     if (inputSize < (int)LZ4_64KLIMIT)
-        result = LZ4_compress_generic((void*)ctx, source, dest, inputSize, 0, notLimited, byU16, noDict, noDictIssue);
+        result = LZ4_compress_generic(NULL, 0, 0, (void*)ctx, source, dest, inputSize, 0, notLimited, byU16, noDict, noDictIssue, LZ4_HASHLOG, 1);
     else
-        result = LZ4_compress_generic((void*)ctx, source, dest, inputSize, 0, notLimited, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue);
+        result = LZ4_compress_generic(NULL, 0, 0, (void*)ctx, source, dest, inputSize, 0, notLimited, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue, LZ4_HASHLOG, 1);
 
 #if (HEAPMODE)
     FREEMEM(ctx);
@@ -670,9 +733,9 @@ int LZ4_compress_limitedOutput(const char* source, char* dest, int inputSize, in
     int result;
 
     if (inputSize < (int)LZ4_64KLIMIT)
-        result = LZ4_compress_generic((void*)ctx, source, dest, inputSize, maxOutputSize, limitedOutput, byU16, noDict, noDictIssue);
+        result = LZ4_compress_generic(NULL, 0, 0, (void*)ctx, source, dest, inputSize, maxOutputSize, limitedOutput, byU16, noDict, noDictIssue, LZ4_HASHLOG, 1);
     else
-        result = LZ4_compress_generic((void*)ctx, source, dest, inputSize, maxOutputSize, limitedOutput, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue);
+        result = LZ4_compress_generic(NULL, 0, 0, (void*)ctx, source, dest, inputSize, maxOutputSize, limitedOutput, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue, LZ4_HASHLOG, 1);
 
 #if (HEAPMODE)
     FREEMEM(ctx);
@@ -680,6 +743,46 @@ int LZ4_compress_limitedOutput(const char* source, char* dest, int inputSize, in
     return result;
 }
 
+int LZ4_compress_prefix(const char* source, char* dest, int inputSize, int prefixSize,
+                        int acceleration, int memoryUsage)
+{
+    const BYTE* dictionary;
+    const BYTE* p;
+    U32 hashLog;
+    void* table;
+    int result;
+
+    if (!memoryUsage) memoryUsage = LZ4_MEMORY_USAGE;
+    if ((memoryUsage < LZ4_MEMORY_USAGE_MIN) || (memoryUsage > LZ4_MEMORY_USAGE_MAX)) return 0;
+    if (prefixSize < 0) return 0;
+    if (acceleration < 1) acceleration = 1;
+    if (acceleration > LZ4_ACCELERATION_MAX) acceleration = LZ4_ACCELERATION_MAX;   /* acceleration << skipStrength fits */
+    hashLog = memoryUsage - 2;
+    table = ALLOCATOR(4, (size_t)1 << hashLog);
+    if (!table) return 0;
+
+    if (prefixSize > (int)(64 KB)) prefixSize = 64 KB;
+    dictionary = (const BYTE*)source - prefixSize;
+
+    if (!prefixSize)
+    {
+        if (inputSize < (int)LZ4_64KLIMIT)
+            result = LZ4_compress_generic(dictionary, prefixSize, prefixSize, table, source, dest, inputSize, 0, notLimited, byU16, noDict, noDictIssue, hashLog, acceleration);
+        else
+            result = LZ4_compress_generic(dictionary, prefixSize, prefixSize, table, source, dest, inputSize, 0, notLimited, (sizeof(void*)==8) ? byU32 : byPtr, noDict, noDictIssue, hashLog, acceleration);
+    }
+    else
+    {
+        /* as LZ4_loadDict() and then LZ4_compress_continue() */
+        for (p = dictionary; p <= (const BYTE*)source - MINMATCH; p += 3)
+            LZ4_putPosition(p, table, byU32, hashLog, dictionary);
+        result = LZ4_compress_generic(dictionary, prefixSize, prefixSize, table, source, dest, inputSize, 0, notLimited, byU32, withPrefix64k, noDictIssue, hashLog, acceleration);
+    }
+
+    FREEMEM(table);
+    return result;
+}
+
 
 /*****************************************
    Experimental : Streaming functions
@@ -724,7 +827,7 @@ int LZ4_loadDict (void* LZ4_dict, const char* dictionary, int dictSize)
 
     while (p <= dictEnd-MINMATCH)
     {
-        LZ4_putPosition(p, dict, byU32, base);
+        LZ4_putPosition(p, dict, byU32, LZ4_HASHLOG, base);
         p+=3;
     }
 
@@ -781,9 +884,9 @@ FORCE_INLINE int LZ4_compress_continue_generic (void* LZ4_stream, const char* so
     {
         int result;
         if ((streamPtr->dictSize < 64 KB) && (streamPtr->dictSize < streamPtr->currentOffset))
-            result = LZ4_compress_generic(LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, withPrefix64k, dictSmall);
+            result = LZ4_compress_generic(streamPtr->dictionary, streamPtr->dictSize, streamPtr->currentOffset, LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, withPrefix64k, dictSmall, LZ4_HASHLOG, 1);
         else
-            result = LZ4_compress_generic(LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, withPrefix64k, noDictIssue);
+            result = LZ4_compress_generic(streamPtr->dictionary, streamPtr->dictSize, streamPtr->currentOffset, LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, withPrefix64k, noDictIssue, LZ4_HASHLOG, 1);
         streamPtr->dictSize += (U32)inputSize;
         streamPtr->currentOffset += (U32)inputSize;
         return result;
@@ -793,9 +896,9 @@ FORCE_INLINE int LZ4_compress_continue_generic (void* LZ4_stream, const char* so
     {
         int result;
         if ((streamPtr->dictSize < 64 KB) && (streamPtr->dictSize < streamPtr->currentOffset))
-            result = LZ4_compress_generic(LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, usingExtDict, dictSmall);
+            result = LZ4_compress_generic(streamPtr->dictionary, streamPtr->dictSize, streamPtr->currentOffset, LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, usingExtDict, dictSmall, LZ4_HASHLOG, 1);
         else
-            result = LZ4_compress_generic(LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, usingExtDict, noDictIssue);
+            result = LZ4_compress_generic(streamPtr->dictionary, streamPtr->dictSize, streamPtr->currentOffset, LZ4_stream, source, dest, inputSize, maxOutputSize, limit, byU32, usingExtDict, noDictIssue, LZ4_HASHLOG, 1);
         streamPtr->dictionary = (const BYTE*)source;
         streamPtr->dictSize = (U32)inputSize;
         streamPtr->currentOffset += (U32)inputSize;
@@ -826,7 +929,7 @@ int LZ4_compress_forceExtDict (LZ4_stream_t* LZ4_dict, const char* source, char*
     if (smallest > (const BYTE*) source) smallest = (const BYTE*) source;
     LZ4_renormDictT((LZ4_stream_t_internal*)LZ4_dict, smallest);
 
-    result = LZ4_compress_generic(LZ4_dict, source, dest, inputSize, 0, notLimited, byU32, usingExtDict, noDictIssue);
+    result = LZ4_compress_generic(streamPtr->dictionary, streamPtr->dictSize, streamPtr->currentOffset, LZ4_dict, source, dest, inputSize, 0, notLimited, byU32, usingExtDict, noDictIssue, LZ4_HASHLOG, 1);
 
     streamPtr->dictionary = (const BYTE*)source;
     streamPtr->dictSize = (U32)inputSize;
@@ -899,6 +1002,12 @@ FORCE_INLINE int LZ4_decompress_generic(
 
     const int checkOffset = (endOnInput) && (dictSize < (int)(64 KB));
 
+    /* shortcut bounds : literals of up to 14 bytes (8 without endOnInput) within the same
+       margins which the regular path requires, so both take the same decisions */
+    const size_t shortLits = (endOnInput) ? 14 : 8;
+    const BYTE* const shortiend = iend - 14 - (2+1+LASTLITERALS);
+    BYTE* const shortoend = oend - 16 - MFLIMIT;
+
 
     /* Special cases */
     if ((partialDecoding) && (oexit> oend-MFLIMIT)) oexit = oend-MFLIMIT;                        /* targetOutputSize too high => decode everything */
@@ -914,9 +1023,27 @@ FORCE_INLINE int LZ4_decompress_generic(
 
         /* get runlength */
         token = *ip++;
-        if ((length=(token>>ML_BITS)) == RUN_MASK)
+        length = token>>ML_BITS;
+
+        /*
+         * Shortcut for the common case : short literals with enough room on both sides
+         * are copied with one 16 bytes move (8 without endOnInput), and without the
+         * per sequence literal bound checks. The offset is read and it continues at
+         * the match path, whose wide copies already cover short matches.
+         */
+        if ((length <= shortLits) && ((endOnInput) ? (ip <= shortiend) : 1) && likely(op <= shortoend)
+            && ((partialDecoding) ? (op+length <= oexit) : 1))
+        {
+            if (endOnInput) LZ4_COPY16(op, ip); else memcpy(op, ip, 8);
+            op += length; ip += length;
+            LZ4_READ_LITTLEENDIAN_16(ref,op,ip); ip+=2;
+            goto _copy_match;
+        }
+
+        if (length == RUN_MASK)
         {
             unsigned s;
+            if ((endOnInput) && unlikely(ip >= iend)) goto _output_error;   /* Error : no length byte */
             do
             {
                 s = *ip++;
@@ -952,6 +1079,8 @@ FORCE_INLINE int LZ4_decompress_generic(
 
         /* get offset */
         LZ4_READ_LITTLEENDIAN_16(ref,cpy,ip); ip+=2;
+_copy_match:
+        if (unlikely(ref == op)) goto _output_error;   /* Error : offset 0, which would copy unwritten output */
         if ((checkOffset) && (unlikely(ref < lowLimit))) goto _output_error;   /* Error : offset outside destination buffer */
 
         /* get matchlength */
@@ -1000,7 +1129,21 @@ FORCE_INLINE int LZ4_decompress_generic(
             continue;
         }
 
-        /* copy repeated sequence */
+        /* copy repeated sequence : wide copies, a fill or a pattern when the overrun fits */
+        cpy = op + length + MINMATCH;
+        if (likely(cpy <= oend-16))
+        {
+            const size_t offset = op-ref;
+            if (offset >= 16) { LZ4_WILDCOPY16(op, ref, cpy); op = cpy; continue; }
+            if (offset == 1) { memset(op, *ref, cpy-op); op = cpy; continue; }
+            {
+                const size_t step = LZ4_patternStep[offset];
+                LZ4_PATTERN16(op, ref, offset);
+                for (op += step; op < cpy; op += step) LZ4_COPY16(op, op-step);
+                op = cpy;
+                continue;
+            }
+        }
         if (unlikely((op-ref)<(int)STEPSIZE))
         {
             const size_t dec64 = dec64table[(sizeof(void*)==4) ? 0 : op-ref];
@@ -1157,6 +1300,11 @@ int LZ4_decompress_safe_usingDict(const char* source, char* dest, int compressed
     return LZ4_decompress_generic(source, dest, compressedSize, maxOutputSize, endOnInputSize, full, 0, usingExtDict, dictStart, dictSize);
 }
 
+int LZ4_decompress_safe_partial_usingDict(const char* source, char* dest, int compressedSize, int targetOutputSize, int maxOutputSize, const char* dictStart, int dictSize)
+{
+    return LZ4_decompress_generic(source, dest, compressedSize, maxOutputSize, endOnInputSize, partial, targetOutputSize, usingExtDict, dictStart, dictSize);
+}
+
 int LZ4_decompress_fast_usingDict(const char* source, char* dest, int originalSize, const char* dictStart, int dictSize)
 {
     return LZ4_decompress_generic(source, dest, 0, originalSize, endOnOutputSize, full, 0, usingExtDict, dictStart, dictSize);
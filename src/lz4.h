@@ -57,6 +57,9 @@ extern "C" {
  * Default value is 14, for 16KB, which nicely fits into Intel x86 L1 cache
  */
 #define LZ4_MEMORY_USAGE 14
+#define LZ4_MEMORY_USAGE_MIN 10    /* the range of LZ4_compress_prefix() */
+#define LZ4_MEMORY_USAGE_MAX 20
+#define LZ4_ACCELERATION_MAX 65537  /* the largest acceleration of LZ4_compress_prefix() */
 
 
 /**************************************
@@ -128,6 +131,22 @@ LZ4_compress_limitedOutput() :
 int LZ4_compress_limitedOutput (const char* source, char* dest, int inputSize, int maxOutputSize);
 
 
+/*
+LZ4_compress_prefix() :
+    Same as LZ4_compress(), with a few more options.
+    prefixSize : the number of bytes before 'source' which matches may reference (up to 64 KB are used),
+                 as if they were compressed before it in the same stream. Can be 0.
+    acceleration : 1 is the same search as LZ4_compress(). Larger values skip ahead faster where matches
+                   aren't found, which is faster but compresses less.
+                   Values below 1 are taken as 1, and above LZ4_ACCELERATION_MAX as LZ4_ACCELERATION_MAX.
+    memoryUsage : the hash table is 2^memoryUsage bytes, from LZ4_MEMORY_USAGE_MIN to LZ4_MEMORY_USAGE_MAX,
+                  or 0 for LZ4_MEMORY_USAGE. It's allocated on the heap.
+    return : the number of bytes written in buffer 'dest'
+             or 0 if the compression fails (including invalid arguments or no memory)
+*/
+int LZ4_compress_prefix (const char* source, char* dest, int inputSize, int prefixSize, int acceleration, int memoryUsage);
+
+
 /*
 LZ4_decompress_fast() :
     originalSize : is the original and therefore uncompressed size
@@ -269,6 +288,14 @@ Advanced decoding functions :
 int LZ4_decompress_safe_usingDict (const char* source, char* dest, int compressedSize, int maxOutputSize, const char* dictStart, int dictSize);
 int LZ4_decompress_fast_usingDict (const char* source, char* dest, int originalSize, const char* dictStart, int dictSize);
 
+/*
+LZ4_decompress_safe_partial_usingDict() :
+    The same as LZ4_decompress_safe_partial(), with a dictionary as with the _usingDict() functions.
+    It can also decode from any sequence of a block, if the dictionary holds the preceding 64 KB
+    of output (or all of it, if less).
+*/
+int LZ4_decompress_safe_partial_usingDict (const char* source, char* dest, int compressedSize, int targetOutputSize, int maxOutputSize, const char* dictStart, int dictSize);
+
 
 
 #if defined (__cplusplus)
@@ -0,0 +1,564 @@
+/*
+   mozlz4 - Decompress Mozilla mozLz40 data (bookmarks backups, sessionstore)
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+
+/*
+   See mozlz4.h for the API. The decoding itself is done by lz4.c, except for
+   streaming and parallel decoding, where the block is parsed here sequence by
+   sequence (as it is to find checkpoints).
+*/
+
+#include <string.h>
+
+#include "lz4.h"
+#include "mozlz4.h"
+
+#define OUT_SIZE (MOZLZ4_STREAM_WINDOW + MOZLZ4_STREAM_CHUNK)
+
+
+int mozlz4_peek_size(const void *buf, size_t len, size_t *size)
+{
+    const unsigned char *hdr = buf;
+    size_t i;
+    if (len < MOZLZ4_HEADER_SIZE || memcmp(MOZLZ4_MAGIC, hdr, MOZLZ4_MAGIC_SIZE))
+        return MOZLZ4_ERR_FORMAT;
+
+    *size = 0;
+    for (i = 0; i < 4; i++)
+        *size += (size_t)hdr[MOZLZ4_MAGIC_SIZE + i] << (8 * i);
+    return MOZLZ4_OK;
+}
+
+int mozlz4_decode_into(const void *src, size_t srclen, void *dst, size_t dstcap, size_t *dsize)
+{
+    size_t osize;
+    int rv;
+    if (mozlz4_peek_size(src, srclen, &osize) || srclen - MOZLZ4_HEADER_SIZE > (size_t)LZ4_MAX_INPUT_SIZE)
+        return MOZLZ4_ERR_FORMAT;
+    if (dstcap < osize)
+        return MOZLZ4_ERR_SIZE;
+    if (osize > 0x7fffffff)
+        return MOZLZ4_ERR_FORMAT;  /* unsupported by LZ4_decompress_safe */
+
+    rv = LZ4_decompress_safe((const char *)src + MOZLZ4_HEADER_SIZE, dst,
+                             (int)(srclen - MOZLZ4_HEADER_SIZE), (int)osize);
+    if (rv < 0)
+        return MOZLZ4_ERR_FORMAT;
+    *dsize = rv;
+    return MOZLZ4_OK;
+}
+
+
+/* streaming */
+
+/* Refills ibuf if it's consumed. Returns the number of available bytes */
+static size_t sd_avail(mozlz4_stream_t *s)
+{
+    if (s->ipos == s->ilen) {
+        long n;
+        s->iread += s->ilen;
+        s->ipos = 0;
+        n = s->read_err ? -1 : s->read(s->read_opaque, s->ibuf, sizeof s->ibuf);
+        s->read_err = n < 0;
+        s->ilen = n > 0 ? n : 0;
+    }
+    return s->ilen - s->ipos;
+}
+
+/* Returns the number of input bytes consumed */
+static size_t sd_pos(const mozlz4_stream_t *s)
+{
+    return s->iread + s->ipos;
+}
+
+/* Returns the next input byte, or -1 at EOF or error */
+static int sd_getc(mozlz4_stream_t *s)
+{
+    return sd_avail(s) ? s->ibuf[s->ipos++] : -1;
+}
+
+/* The error for unexpected end of input */
+static int sd_eof_err(mozlz4_stream_t *s)
+{
+    return s->read_err ? MOZLZ4_ERR_READ : MOZLZ4_ERR_FORMAT;
+}
+
+/* Writes pending output. If obuf is full, keeps only the window at its start */
+static int sd_flush(mozlz4_stream_t *s)
+{
+    size_t n = s->opos - s->oflushed;
+    if (n && s->write(s->write_opaque, s->obuf + s->oflushed, n))
+        return MOZLZ4_ERR_WRITE;
+    s->oflushed = s->opos;
+
+    if (s->opos == OUT_SIZE) {
+        memmove(s->obuf, s->obuf + OUT_SIZE - MOZLZ4_STREAM_WINDOW, MOZLZ4_STREAM_WINDOW);
+        s->opos = s->oflushed = MOZLZ4_STREAM_WINDOW;
+    }
+    return MOZLZ4_OK;
+}
+
+/* Adds the extra length bytes which follow a 15 in a token nibble */
+static int sd_length(mozlz4_stream_t *s, size_t *len)
+{
+    int c;
+    do {
+        if ((c = sd_getc(s)) < 0)
+            return sd_eof_err(s);
+        *len += c;
+        if (*len > s->size)
+            return MOZLZ4_ERR_FORMAT;  /* too long anyway, and it can't wrap */
+    } while (c == 255);
+    return MOZLZ4_OK;
+}
+
+/* Decompresses till the end of the block or s->stop, without the last flush.
+ * Like LZ4_decompress_safe, it requires the margins which LZ4 keeps before the
+ * end of the block: literals which a match follows end at least MFLIMIT (12)
+ * bytes before the end of the output, and 8 before the end of the input, and a
+ * match ends at least LASTLITERALS (5) bytes before the end of the output, and
+ * its length bytes 5 before the end of the input */
+static int sd_decode(mozlz4_stream_t *s)
+{
+    size_t iend_min = 0;  /* the input can't end before it */
+    for (;;) {
+        size_t len, off, n;
+        int token, c, err;
+
+        /* literals (a block always ends with literals) */
+        if ((token = sd_getc(s)) < 0)
+            return sd_eof_err(s);
+        len = token >> 4;
+        if (len == 15 && (err = sd_length(s, &len)))
+            return err;
+        if (len > s->size - s->total)
+            return MOZLZ4_ERR_FORMAT;
+        if (len >= s->stop - s->total)
+            len = s->stop - s->total;  /* the last bytes to decompress */
+        s->total += len;
+
+        while (len) {
+            if (s->opos == OUT_SIZE && (err = sd_flush(s)))
+                return err;
+            if (!sd_avail(s))
+                return sd_eof_err(s);
+            n = OUT_SIZE - s->opos;
+            if (n > len)
+                n = len;
+            if (n > s->ilen - s->ipos)
+                n = s->ilen - s->ipos;
+            memcpy(s->obuf + s->opos, s->ibuf + s->ipos, n);
+            s->opos += n;
+            s->ipos += n;
+            len -= n;
+        }
+        if (s->total == s->stop)
+            return MOZLZ4_OK;
+
+        /* match offset, or the end of the block (the block of an empty output
+         * is a single 0 token) */
+        if ((c = sd_getc(s)) < 0) {
+            if (s->read_err)
+                return MOZLZ4_ERR_READ;
+            return sd_pos(s) < iend_min || (!s->size && token) ? MOZLZ4_ERR_FORMAT : MOZLZ4_OK;
+        }
+        if (s->total + 12 > s->size)
+            return MOZLZ4_ERR_FORMAT;
+        iend_min = sd_pos(s) - 1 + 8;
+        off = c;
+        if ((c = sd_getc(s)) < 0)
+            return sd_eof_err(s);
+        off |= (size_t)c << 8;
+        if (!off || off > s->total)
+            return MOZLZ4_ERR_FORMAT;
+
+        /* match length, and copy (the source may overlap the destination) */
+        len = token & 15;
+        if (len == 15) {
+            if ((err = sd_length(s, &len)))
+                return err;
+            if (iend_min < sd_pos(s) - 1 + 5)
+                iend_min = sd_pos(s) - 1 + 5;
+        }
+        len += 4;
+        if (len + 5 > s->size - s->total)
+            return MOZLZ4_ERR_FORMAT;
+        if (len >= s->stop - s->total)
+            len = s->stop - s->total;
+        s->total += len;
+
+        while (len) {
+            unsigned char *d;
+            if (s->opos == OUT_SIZE && (err = sd_flush(s)))
+                return err;
+            n = OUT_SIZE - s->opos;
+            if (n > len)
+                n = len;
+            d = s->obuf + s->opos;
+            if (off >= n) {
+                memcpy(d, d - off, n);
+            } else {
+                size_t j;
+                for (j = 0; j < n; j++)
+                    d[j] = d[j - off];
+            }
+            s->opos += n;
+            len -= n;
+        }
+        if (s->total == s->stop)
+            return MOZLZ4_OK;
+    }
+}
+
+
+void mozlz4_stream_init(mozlz4_stream_t *s, mozlz4_read_fn read, void *read_opaque,
+                        mozlz4_write_fn write, void *write_opaque)
+{
+    s->read = read;
+    s->read_opaque = read_opaque;
+    s->write = write;
+    s->write_opaque = write_opaque;
+    s->read_err = 0;
+    s->iread = s->ipos = s->ilen = s->opos = s->oflushed = 0;
+    s->size = s->total = 0;
+}
+
+int mozlz4_stream_header(mozlz4_stream_t *s)
+{
+    unsigned char hdr[MOZLZ4_HEADER_SIZE];
+    size_t i;
+    for (i = 0; i < sizeof hdr; i++) {
+        int c = sd_getc(s);
+        if (c < 0)
+            return sd_eof_err(s);
+        hdr[i] = c;
+    }
+    return mozlz4_peek_size(hdr, sizeof hdr, &s->size);
+}
+
+int mozlz4_stream_decode(mozlz4_stream_t *s, size_t stop)
+{
+    int err;
+    s->stop = stop;
+    if ((err = sd_decode(s)))
+        return err;
+    return sd_flush(s);
+}
+
+
+/* parallel */
+
+/* Adds the extra length bytes at *p (before end) which follow a 15 in a token
+ * nibble. Returns non-zero if the input ends */
+static int pd_length(const unsigned char **p, const unsigned char *end, size_t *len)
+{
+    unsigned c;
+    do {
+        if (*p == end)
+            return 1;
+        c = *(*p)++;
+        *len += c;
+    } while (c == 255);
+    return 0;
+}
+
+/* Control characters other than tab, LF and CR can't appear in JSON text */
+#define IS_JSON_BYTE(b) ((b) >= 0x20 || (b) == '\t' || (b) == '\n' || (b) == '\r')
+
+#define SYNC_SEQUENCES  32   /* checked from a candidate start */
+#define SYNC_SKIP       256  /* then skipped: parses from a wrong start usually
+                              * reach a real sequence start within dozens */
+
+/* Parses up to n sequences from *ip, and returns non-zero if they have non-zero
+ * offsets, lengths within the input, and, if json, JSON literals. Advances *ip
+ * to after them (iend at the end of the block) */
+static int pd_parse(const unsigned char **pp, const unsigned char *iend, int n, int json)
+{
+    const unsigned char *ip = *pp;
+    for (; n > 0 && ip < iend; n--) {
+        size_t len, j;
+        unsigned token = *ip++;
+
+        len = token >> 4;
+        if ((len == 15 && pd_length(&ip, iend, &len)) || len > (size_t)(iend - ip))
+            return 0;
+        for (j = 0; json && j < len; j++) {
+            if (!IS_JSON_BYTE(ip[j]))
+                return 0;
+        }
+        ip += len;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2 || !(ip[0] | ip[1]))
+            return 0;
+        ip += 2;
+        len = token & 15;
+        if ((len == 15 && pd_length(&ip, iend, &len)) || ip == iend)
+            return 0;
+    }
+    *pp = ip;
+    return 1;
+}
+
+int mozlz4_sync(const void *src, size_t srclen, size_t from, size_t to, size_t *pos)
+{
+    const unsigned char *blk = (const unsigned char *)src + MOZLZ4_HEADER_SIZE;
+    const unsigned char *iend, *ip;
+
+    if (srclen < MOZLZ4_HEADER_SIZE)
+        return MOZLZ4_ERR_FORMAT;
+    iend = blk + (srclen - MOZLZ4_HEADER_SIZE);
+    if (to > (size_t)(iend - blk))
+        to = iend - blk;
+    for (; from < to; from++) {
+        ip = blk + from;
+        if (pd_parse(&ip, iend, SYNC_SEQUENCES, 1) && pd_parse(&ip, iend, SYNC_SKIP, 0) && ip < iend) {
+            *pos = ip - blk;
+            return MOZLZ4_OK;
+        }
+    }
+    return MOZLZ4_ERR_FORMAT;
+}
+
+int mozlz4_decode_chunk(const void *src, size_t srclen, mozlz4_chunk_t *c, size_t stop,
+                        unsigned short *sym, size_t cap)
+{
+    const unsigned char *blk = (const unsigned char *)src + MOZLZ4_HEADER_SIZE;
+    const unsigned char *ip, *iend;
+    size_t o = c->olen;
+
+    if (srclen < MOZLZ4_HEADER_SIZE || c->ipos > srclen - MOZLZ4_HEADER_SIZE)
+        return MOZLZ4_ERR_FORMAT;
+    ip = blk + c->ipos;
+    iend = blk + (srclen - MOZLZ4_HEADER_SIZE);
+
+    while (ip < iend && (size_t)(ip - blk) < stop) {
+        const unsigned char *seq = ip, *lits;
+        size_t nlits, len = 0, off = 0, j;
+        unsigned token = *ip++;
+
+        /* parse the sequence. A block ends with the literals of the last one,
+         * and like LZ4_decompress_safe, literals which end in the last 8 bytes
+         * must be the last, and match length bytes can't be in the last 5 */
+        nlits = token >> 4;
+        if ((nlits == 15 && pd_length(&ip, iend, &nlits)) || nlits > (size_t)(iend - ip))
+            return MOZLZ4_ERR_FORMAT;
+        lits = ip;
+        ip += nlits;
+        if (ip != iend) {
+            if (iend - ip < 8 || !(off = ip[0] | (size_t)ip[1] << 8))
+                return MOZLZ4_ERR_FORMAT;
+            ip += 2;
+            len = token & 15;
+            if (len == 15 && pd_length(&ip, iend - 4, &len))
+                return MOZLZ4_ERR_FORMAT;
+            len += 4;
+        }
+        if (nlits > cap - o || len > cap - o - nlits) {
+            c->ipos = seq - blk;
+            c->olen = o;
+            return MOZLZ4_ERR_SIZE;
+        }
+
+        if (nlits <= 16 && iend - lits >= 16 && cap - o >= 16) {
+            /* the usual short literals, as 16 (buf can't alias, so it vectorizes) */
+            unsigned short buf[16];
+            for (j = 0; j < 16; j++)
+                buf[j] = lits[j];
+            memcpy(sym + o, buf, sizeof buf);
+        } else {
+            for (j = 0; j < nlits; j++)
+                sym[o + j] = lits[j];
+        }
+        o += nlits;
+        if (ip == iend) {
+            if (o > c->need)
+                c->need = o;
+            break;
+        }
+        /* LZ4 leaves MFLIMIT (12) after literals, and LASTLITERALS (5) after a match */
+        j = len + 5 > 12 ? len + 5 : 12;
+        if (o + j > c->need)
+            c->need = o + j;
+
+        /* the match. The part of the source before the chunk is copied from
+         * the window or referenced, and the rest may overlap the destination */
+        if (off > o) {
+            size_t before = off - o < len ? off - o : len;
+            if (off - o > c->dist)
+                c->dist = off - o;
+            if (c->window) {
+                if (off - o > c->window_len)
+                    return MOZLZ4_ERR_FORMAT;
+                for (j = 0; j < before; j++)
+                    sym[o + j] = c->window[-(ptrdiff_t)(off - o - j)];
+            } else {
+                if (off - o > MOZLZ4_CHUNK_WINDOW)
+                    return MOZLZ4_ERR_WINDOW;
+                for (j = 0; j < before; j++)
+                    sym[o + j] = (unsigned short)(256 + MOZLZ4_CHUNK_WINDOW - (off - o) + j);
+            }
+            o += before;
+            len -= before;
+        }
+        if (off >= 16 && cap - o >= len + 16) {
+            for (j = 0; j < len; j += 16)
+                memcpy(sym + o + j, sym + o + j - off, 16 * sizeof *sym);
+        } else if (off >= len) {
+            if (len)  /* else sym + o - off may be before sym */
+                memcpy(sym + o, sym + o - off, len * sizeof *sym);
+        } else {
+            for (j = 0; j < len; j++)
+                sym[o + j] = sym[o + j - off];
+        }
+        o += len;
+    }
+
+    c->ipos = ip - blk;
+    c->olen = o;
+    return MOZLZ4_OK;
+}
+
+int mozlz4_chunk_resolve(void *dst, size_t opos, const mozlz4_chunk_t *c,
+                         const unsigned short *sym, size_t start, size_t n)
+{
+    unsigned char *d = dst;
+    unsigned char *out = d + opos;
+    size_t i, j;
+
+    if (c->dist > opos)
+        return MOZLZ4_ERR_FORMAT;
+    /* mostly bytes: narrow 64 symbols at a time (via buf, which can't alias,
+     * so it vectorizes), and then fix the references, if any.
+     * The window index (opos - MOZLZ4_CHUNK_WINDOW) may wrap, but not the sum */
+    for (i = start; i < start + n; i += 64) {
+        size_t m = start + n - i < 64 ? start + n - i : 64;
+        unsigned char buf[64];
+        unsigned short any = 0;
+        if (m == 64) {
+            for (j = 0; j < 64; j++) {
+                buf[j] = (unsigned char)sym[i + j];
+                any |= sym[i + j];
+            }
+            memcpy(out + i, buf, 64);
+        } else {
+            for (j = 0; j < m; j++) {
+                out[i + j] = (unsigned char)sym[i + j];
+                any |= sym[i + j];
+            }
+        }
+        if (any < 256)
+            continue;
+        for (j = i; j < i + m; j++) {
+            if (sym[j] >= 256)
+                out[j] = d[opos - MOZLZ4_CHUNK_WINDOW + (sym[j] - 256)];
+        }
+    }
+    return MOZLZ4_OK;
+}
+
+
+/* random access */
+
+int mozlz4_skip(const void *src, size_t srclen, size_t *ipos, size_t *opos, size_t stop)
+{
+    const unsigned char *blk = (const unsigned char *)src + MOZLZ4_HEADER_SIZE;
+    const unsigned char *ip, *iend;
+    size_t o = *opos;
+
+    if (srclen < MOZLZ4_HEADER_SIZE || *ipos > srclen - MOZLZ4_HEADER_SIZE)
+        return MOZLZ4_ERR_FORMAT;
+    ip = blk + *ipos;
+    iend = blk + (srclen - MOZLZ4_HEADER_SIZE);
+
+    while (ip < iend && o < stop) {
+        size_t len;
+        unsigned token = *ip++;
+
+        len = token >> 4;
+        if ((len == 15 && pd_length(&ip, iend, &len)) || len > (size_t)(iend - ip))
+            return MOZLZ4_ERR_FORMAT;
+        ip += len;
+        o += len;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return MOZLZ4_ERR_FORMAT;
+        ip += 2;
+        len = token & 15;
+        if (len == 15 && pd_length(&ip, iend, &len))
+            return MOZLZ4_ERR_FORMAT;
+        o += len + 4;
+    }
+
+    *ipos = ip - blk;
+    *opos = o;
+    return MOZLZ4_OK;
+}
+
+int mozlz4_decode_from(const void *src, size_t srclen, size_t ipos, size_t opos,
+                       const void *window, size_t window_len,
+                       void *dst, size_t dstcap, size_t n, size_t *dsize)
+{
+    size_t size, ilen;
+    int rv, all;
+
+    if (mozlz4_peek_size(src, srclen, &size) || ipos > srclen - MOZLZ4_HEADER_SIZE
+        || opos > size || window_len > opos)
+        return MOZLZ4_ERR_FORMAT;
+    ilen = srclen - MOZLZ4_HEADER_SIZE - ipos;
+    if (ilen > (size_t)LZ4_MAX_INPUT_SIZE)
+        return MOZLZ4_ERR_FORMAT;
+    if (!ilen || opos == size) {
+        *dsize = 0;  /* nothing after opos */
+        return MOZLZ4_OK;
+    }
+
+    if (dstcap > size - opos)
+        dstcap = size - opos;
+    all = dstcap == size - opos;
+    if (dstcap > 0x7fffffff) {
+        dstcap = 0x7fffffff;  /* the most LZ4 can take */
+        all = 0;
+    }
+    if (n > dstcap)
+        n = dstcap;
+
+    rv = LZ4_decompress_safe_partial_usingDict((const char *)src + MOZLZ4_HEADER_SIZE + ipos,
+                                               dst, (int)ilen, (int)n, (int)dstcap,
+                                               window, (int)window_len);
+    if (rv < 0)
+        return all ? MOZLZ4_ERR_FORMAT : MOZLZ4_ERR_SIZE;
+    *dsize = rv;
+    return MOZLZ4_OK;
+}
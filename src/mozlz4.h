@@ -0,0 +1,252 @@
+/*
+   mozlz4 - Decompress Mozilla mozLz40 data (bookmarks backups, sessionstore)
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+#pragma once
+
+#include <stddef.h>
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+
+/*
+   The mozLz40 format: the 8 bytes magic "mozLz40\0", the decompressed size as
+   4 bytes little endian, and then a single raw LZ4 block.
+
+   None of the functions allocate memory, and all of them are thread safe as
+   long as different threads use different buffers/streams (or, for parallel
+   decompression, different chunks).
+*/
+#define MOZLZ4_MAGIC        "mozLz40"   /* sizeof is 8, with the terminating \0 */
+#define MOZLZ4_MAGIC_SIZE   8
+#define MOZLZ4_HEADER_SIZE  12          /* magic and decompressed size */
+
+/* Return values */
+#define MOZLZ4_OK          0
+#define MOZLZ4_ERR_FORMAT -1    /* not mozLz40, or malformed compressed data */
+#define MOZLZ4_ERR_READ   -2    /* the read callback failed */
+#define MOZLZ4_ERR_WRITE  -3    /* the write callback failed */
+#define MOZLZ4_ERR_SIZE   -4    /* the output buffer is too small */
+
+
+/*
+mozlz4_peek_size() :
+    Reads the header at buf, of len bytes (at least MOZLZ4_HEADER_SIZE).
+    On success, sets *size to the decompressed size.
+    return : MOZLZ4_OK, or MOZLZ4_ERR_FORMAT if buf doesn't start with a header.
+*/
+int mozlz4_peek_size(const void *buf, size_t len, size_t *size);
+
+/*
+mozlz4_decode_into() :
+    Decompresses the mozLz40 data src of srclen bytes (header included) into
+    dst, which must be at least the size from mozlz4_peek_size().
+    On success, sets *dsize to the decompressed size, which can be smaller
+    than the size from the header if the data is inconsistent.
+    return : MOZLZ4_OK, MOZLZ4_ERR_FORMAT or MOZLZ4_ERR_SIZE.
+    It never reads or writes outside of src and dst.
+*/
+int mozlz4_decode_into(const void *src, size_t srclen, void *dst, size_t dstcap, size_t *dsize);
+
+
+/***********************************************
+   Streaming Decompression
+***********************************************/
+
+/*
+    Decompresses with bounded memory: the LZ4 block is parsed sequence by
+    sequence, keeping only the last 64K of output (the maximum match offset).
+    Input is pulled using the read callback, and output is pushed in chunks
+    of up to MOZLZ4_STREAM_CHUNK bytes using the write callback.
+
+    mozlz4_read_fn : reads up to size bytes into buf.
+        return : the number of bytes read, 0 at EOF, or negative on error.
+    mozlz4_write_fn : writes size bytes from buf.
+        return : 0 to continue, or non-zero to stop with MOZLZ4_ERR_WRITE.
+*/
+typedef long (*mozlz4_read_fn)(void *opaque, void *buf, size_t size);
+typedef int (*mozlz4_write_fn)(void *opaque, const void *buf, size_t size);
+
+#define MOZLZ4_STREAM_IN_SIZE  (16 * 1024)
+#define MOZLZ4_STREAM_WINDOW   (64 * 1024)
+#define MOZLZ4_STREAM_CHUNK    (64 * 1024)
+
+/*
+ * mozlz4_stream_t
+ * The caller provides the memory (about 144K) and initializes it using
+ * mozlz4_stream_init(). It can be reused for several streams.
+ * Only size and total may be read directly, the rest is private.
+ */
+typedef struct {
+    size_t size;    /* decompressed size from the header */
+    size_t total;   /* decompressed so far */
+
+    mozlz4_read_fn read;
+    void *read_opaque;
+    mozlz4_write_fn write;
+    void *write_opaque;
+    int read_err;
+    size_t iread;           /* input before ibuf */
+    size_t ipos, ilen;      /* ibuf content */
+    size_t opos, oflushed;  /* obuf content, and how much of it was written */
+    size_t stop;
+    unsigned char ibuf[MOZLZ4_STREAM_IN_SIZE];
+    unsigned char obuf[MOZLZ4_STREAM_WINDOW + MOZLZ4_STREAM_CHUNK];
+} mozlz4_stream_t;
+
+/*
+ * mozlz4_stream_init
+ * Prepares s for a new stream, which is read using read(read_opaque, ...) and
+ * written using write(write_opaque, ...).
+ */
+void mozlz4_stream_init(mozlz4_stream_t *s, mozlz4_read_fn read, void *read_opaque,
+                        mozlz4_write_fn write, void *write_opaque);
+
+/*
+ * mozlz4_stream_header
+ * Reads and validates the header, and sets s->size.
+ * Return : MOZLZ4_OK, MOZLZ4_ERR_FORMAT or MOZLZ4_ERR_READ.
+ */
+int mozlz4_stream_header(mozlz4_stream_t *s);
+
+/*
+ * mozlz4_stream_decode
+ * Decompresses the rest of the stream after mozlz4_stream_header(), or only
+ * till s->total reaches stop. All the output is written before it returns.
+ * Return : MOZLZ4_OK or a MOZLZ4_ERR_* value.
+ */
+int mozlz4_stream_decode(mozlz4_stream_t *s, size_t stop);
+
+
+/***********************************************
+   Parallel Decompression
+***********************************************/
+
+/*
+    The block can be decoded in chunks, concurrently. LZ4 has no sync points,
+    so a chunk starts where mozlz4_sync() finds that the sequences parse as
+    JSON text, and it's decoded before the output which precedes it is known:
+    each byte is decoded as a symbol, which is either the byte value, or a
+    reference to the window of MOZLZ4_CHUNK_WINDOW bytes which precedes the
+    chunk. Once that window is final, mozlz4_chunk_resolve() writes the bytes.
+
+    A chunk start is only right if the chunk before it ends exactly there.
+    Otherwise, the chunk before it should continue over it.
+*/
+#define MOZLZ4_CHUNK_WINDOW  (65536 - 256)  /* symbols 256 and up */
+
+#define MOZLZ4_ERR_WINDOW  -5   /* a chunk references beyond the window */
+
+typedef struct {
+    size_t ipos;  /* the next sequence, in the block (which follows the header) */
+    size_t olen;  /* decoded symbols */
+    size_t dist;  /* the farthest reference before the chunk */
+    size_t need;  /* the output size after the chunk start which the sequences
+                   * require (LZ4 keeps a margin after the matches) */
+    /* if not NULL, points just after the final output which precedes the chunk,
+     * of window_len bytes, which is then copied rather than referenced */
+    const unsigned char *window;
+    size_t window_len;
+} mozlz4_chunk_t;
+
+/*
+mozlz4_sync() :
+    Finds a likely, but not certain, sequence start in the block of the mozLz40
+    data src (of srclen bytes, header included): a few hundred sequences after
+    a position in [from, to) from which the sequences parse as JSON text.
+    return : MOZLZ4_OK and sets *pos, or MOZLZ4_ERR_FORMAT if there's none.
+*/
+int mozlz4_sync(const void *src, size_t srclen, size_t from, size_t to, size_t *pos);
+
+/*
+mozlz4_decode_chunk() :
+    Decodes whole sequences from c->ipos of src into sym + c->olen, till
+    c->ipos is stop or more, or at the end of the block.
+    Set c->ipos to the chunk start, and the rest of c to 0 (or set the window)
+    before the first call. Symbols after c->olen (up to cap) may be clobbered.
+    return : MOZLZ4_OK,
+             MOZLZ4_ERR_SIZE if the next sequence doesn't fit in cap symbols
+                (c is at that sequence, to continue with a larger buffer),
+             MOZLZ4_ERR_WINDOW without a window if a reference is too far back
+                (decode it again with a window once the output before it is final),
+             MOZLZ4_ERR_FORMAT if the data is malformed, or the start is wrong.
+*/
+int mozlz4_decode_chunk(const void *src, size_t srclen, mozlz4_chunk_t *c, size_t stop,
+                        unsigned short *sym, size_t cap);
+
+/*
+mozlz4_chunk_resolve() :
+    Writes the symbols [start, start+n) of the chunk c, which is at opos in the
+    output dst, to dst+opos+start. The window before opos must be final.
+    The caller should also check that c->need fits after opos.
+    return : MOZLZ4_OK, or MOZLZ4_ERR_FORMAT if c references before dst.
+*/
+int mozlz4_chunk_resolve(void *dst, size_t opos, const mozlz4_chunk_t *c,
+                         const unsigned short *sym, size_t start, size_t n);
+
+
+/***********************************************
+   Random Access
+***********************************************/
+
+/*
+    Decoding can start at any sequence, given the output which precedes it
+    (up to 64K). A checkpoint is a sequence start with its output offset, as
+    found by mozlz4_skip(), and a copy of that window.
+*/
+
+/*
+mozlz4_skip() :
+    Parses the sequences of the block of src from *ipos without decoding them,
+    till the next one starts at output offset stop or more, or at the end of
+    the block. *opos is the output offset of *ipos, and both are updated.
+    return : MOZLZ4_OK, or MOZLZ4_ERR_FORMAT if the data is malformed.
+*/
+int mozlz4_skip(const void *src, size_t srclen, size_t *ipos, size_t *opos, size_t stop);
+
+/*
+mozlz4_decode_from() :
+    Decompresses the block of src from the sequence at ipos, whose output is at
+    opos, into dst, till it decodes n bytes or more, or till the end. window
+    holds the window_len bytes before opos (which must be min(opos, 64K)).
+    Sets *dsize to the number of decoded bytes.
+    return : MOZLZ4_OK, MOZLZ4_ERR_FORMAT, or MOZLZ4_ERR_SIZE if it fails with
+             dstcap smaller than the decompressed size minus opos (which is
+             always enough, but n plus a few K usually is too).
+*/
+int mozlz4_decode_from(const void *src, size_t srclen, size_t ipos, size_t opos,
+                       const void *window, size_t window_len,
+                       void *dst, size_t dstcap, size_t n, size_t *dsize);
+
+#if defined (__cplusplus)
+}
+#endif
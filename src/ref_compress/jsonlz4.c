@@ -31,28 +31,36 @@
 */
 
 /*
-   lz4.c and lz4.h are verbatim copies from Mozilla source tree mfbt/lz4.*
-   (Mercurial) rev: c3f5e6079284 (2016-05-12) and carry their own license.
+   lz4.c and lz4.h are based on copies from Mozilla source tree mfbt/lz4.*
+   (Mercurial) rev: c3f5e6079284 (2016-05-12), with local performance changes,
+   and carry their own license.
 */
 
-/* Build: copy src/ref_compress/jsonlz4.c to src/ and then:
- * gcc -Wall -o jsonlz4 jsonlz4.c lz4.c
+/* Build: copy src/ref_compress/jsonlz4.c, lz4hc.c and lz4hc.h to src/ and then:
+ * gcc -Wall -pthread -o jsonlz4 jsonlz4.c lz4hc.c lz4.c
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "lz4.h"
+#include "lz4hc.h"
 
 const char mozlz4_magic[] = {109, 111, 122, 76, 122, 52, 48, 0};  /* "mozLz40\0" */
 const int decomp_size = 4;  /* 4 bytes size come after the header */
 
 void exit_usage(int code) {
     fprintf((code ? stderr : stdout), "%s",
-            "Usage: jsonlz4 [-h] IN_FILE OUT_FILE\n"
+            "Usage: jsonlz4 [-h] [-1..-12] [-a N] [-m N] [-j N] IN_FILE OUT_FILE\n"
             "   -h  Display this help and exit.\n"
+            "   -1..-12  Compression level: 1 is the fastest (default), 2-9 search more\n"
+            "            matches, and 10-12 also choose them optimally (slowest).\n"
+            "   -a N  Level 1 only: acceleration, 1 (default) and up, faster but larger.\n"
+            "   -m N  Level 1 only: hash table of 2^N bytes, 10-20 (default 14).\n"
+            "   -j N  Compress using N threads (if IN_FILE is 2M or more).\n"
             "Compress IN_FILE to OUT_FILE with same format as Firefox bookmarks backup.\n"
             "If IN_FILE is '-', compress from standard input.\n"
             "If OUT_FILE is '-', compress to standard output.\n"
@@ -112,26 +120,242 @@ const size_t magic_size = sizeof mozlz4_magic;
 
 #define ERR_CLEANUP(...) { fprintf(stderr, "Error: " __VA_ARGS__); goto cleanup; }
 
+/*
+   Parallel compression (-j N): the input is split into segments, which threads
+   compress as separate blocks, each with the 64K before it as a dictionary, so
+   that matches reach back as they do in a single block. A block ends with a
+   sequence of only literals, so the blocks are stitched into one by moving
+   those literals into the first sequence of the next block. Literals are input
+   bytes, so the moved ones and the ones they join are always contiguous.
+*/
+#define SEGMENT_MIN  (1024 * 1024)
+#define SEGMENTS     4  /* per thread */
+#define DICT_SIZE    (64 * 1024)
+
+typedef struct {
+    pthread_mutex_t lock;
+    const char *src;
+    size_t size, seg;  /* seg: the segment size */
+    int nsegs, level, accel, memory;
+    char **out;        /* the compressed segments */
+    int *csize;
+    int next;          /* the next segment to compress */
+    int failed;
+} par_t;
+
+/* Thread function: compress segments till they're all taken */
+void *compress_worker(void *arg)
+{
+    par_t *p = arg;
+    for (;;) {
+        size_t start, len;
+        int k;
+        pthread_mutex_lock(&p->lock);
+        k = p->failed ? p->nsegs : p->next++;
+        pthread_mutex_unlock(&p->lock);
+        if (k >= p->nsegs)
+            break;
+
+        start = k * p->seg;
+        len = p->size - start < p->seg ? p->size - start : p->seg;
+        if ((p->out[k] = malloc(LZ4_compressBound(len)))) {
+            if (p->level >= LZ4HC_MIN_LEVEL) {
+                p->csize[k] = LZ4HC_compress_prefix(p->src + start, p->out[k], len,
+                                                    k ? DICT_SIZE : 0, p->level);
+            } else {
+                p->csize[k] = LZ4_compress_prefix(p->src + start, p->out[k], len,
+                                                  k ? DICT_SIZE : 0, p->accel, p->memory);
+            }
+        }
+        if (!p->out[k] || !p->csize[k]) {
+            pthread_mutex_lock(&p->lock);
+            p->failed = 1;
+            pthread_mutex_unlock(&p->lock);
+        }
+    }
+    return 0;
+}
+
+/* Reads the literals length of the sequence at b + *pos, and sets *pos to its
+ * literals */
+size_t read_literals(const unsigned char *b, size_t *pos)
+{
+    size_t len = b[(*pos)++] >> 4;
+    if (len == 15) {
+        unsigned c;
+        do {
+            len += c = b[(*pos)++];
+        } while (c == 255);
+    }
+    return len;
+}
+
+/* Writes a token with the match length nibble ml and len literals to d.
+ * Returns the number of bytes written */
+size_t write_literals(unsigned char *d, unsigned ml, const char *lits, size_t len)
+{
+    unsigned char *p = d;
+    size_t n;
+    *p++ = (unsigned char)((len < 15 ? len : 15) << 4 | ml);
+    if (len >= 15) {
+        for (n = len - 15; n >= 255; n -= 255)
+            *p++ = 255;
+        *p++ = (unsigned char)n;
+    }
+    memcpy(p, lits, len);
+    return p + len - d;
+}
+
+/* The size of dst for compress_block */
+size_t compress_bound(size_t size)
+{
+    return LZ4_compressBound(size) + 16 * (size / SEGMENT_MIN + 1);  /* a token per segment */
+}
+
+/* Compresses src of size bytes into dst as one block at level (and at level 1,
+ * with accel and memory as LZ4_compress_prefix), using nthreads threads if it's
+ * large enough. Returns the compressed size, or 0 on failure */
+size_t compress_block(const char *src, size_t size, unsigned char *dst, int nthreads,
+                      int level, int accel, int memory)
+{
+    par_t p;
+    pthread_t *threads = 0;
+    size_t rv = 0, o = 0, pend = 0;  /* pend: the input offset of literals not written yet */
+    int i, k, started = 0;
+
+    memset(&p, 0, sizeof p);
+    p.seg = size / ((size_t)nthreads * SEGMENTS) + 1;
+    if (p.seg < SEGMENT_MIN)
+        p.seg = SEGMENT_MIN;
+    if (nthreads < 2 || size < 2 * p.seg || size > LZ4_MAX_INPUT_SIZE) {
+        if (level >= LZ4HC_MIN_LEVEL)
+            return LZ4HC_compress_prefix(src, (char *)dst, size, 0, level);
+        return LZ4_compress_prefix(src, (char *)dst, size, 0, accel, memory);
+    }
+
+    pthread_mutex_init(&p.lock, 0);
+    p.src = src;
+    p.size = size;
+    p.level = level;
+    p.accel = accel;
+    p.memory = memory;
+    p.nsegs = (size + p.seg - 1) / p.seg;
+    p.out = calloc(p.nsegs, sizeof *p.out);
+    p.csize = calloc(p.nsegs, sizeof *p.csize);
+    threads = calloc(nthreads, sizeof *threads);
+    if (!p.out || !p.csize || !threads)
+        goto cleanup;
+
+    for (; started < nthreads; started++) {
+        if (pthread_create(&threads[started], 0, compress_worker, &p))
+            break;
+    }
+    if (!started)
+        compress_worker(&p);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], 0);
+    if (p.failed)
+        goto cleanup;
+
+    /* stitch */
+    for (k = 0; k < p.nsegs; k++) {
+        const unsigned char *b = (const unsigned char *)p.out[k];
+        size_t n = p.csize[k], pos = 0, lits, last, last_lits, next;
+        size_t start = k * p.seg, end = start + p.seg < size ? start + p.seg : size;
+
+        /* the first sequence, with the pending literals before its own */
+        lits = read_literals(b, &pos);
+        if (pos + lits == n)
+            continue;  /* only literals, which stay pending */
+        o += write_literals(dst + o, b[0] & 15, src + pend, start - pend + lits);
+        pos += lits;  /* its match is copied as is */
+
+        /* and the rest, without the last sequence, whose literals are pending */
+        last = pos + 2;
+        if ((b[0] & 15) == 15) {
+            while (b[last++] == 255)
+                ;
+        }
+        for (;;) {
+            next = last;
+            last_lits = read_literals(b, &next);
+            next += last_lits;
+            if (next == n)
+                break;
+            next += 2;
+            if ((b[last] & 15) == 15) {
+                while (b[next++] == 255)
+                    ;
+            }
+            last = next;
+        }
+        memcpy(dst + o, b + pos, last - pos);
+        o += last - pos;
+        pend = end - last_lits;
+    }
+    o += write_literals(dst + o, 0, src + pend, size - pend);
+    rv = o;
+
+cleanup:
+    for (i = 0; p.out && i < p.nsegs; i++)
+        free(p.out[i]);
+    free(p.out);
+    free(p.csize);
+    free(threads);
+    pthread_mutex_destroy(&p.lock);
+    return rv;
+}
+
 int main(int argc, char **argv)
 {
     size_t isize = 0, osize = 0;
     const char *iname = 0, *oname = 0;
     char *idata = 0, *odata = 0;
     FILE *ofile = 0;
-    int rv = 1, i, csize;
+    int rv = 1, i, nthreads = 1, level = 1, accel = 1, memory = 0, level1_opts = 0;
+    size_t csize;
 
     /* process arguments */
-    if (argc != 3)
-        exit_usage(argc == 2 && !strcmp(argv[1], "-h") ? 0 : 1);
-    if (strcmp("-", argv[1]))
-        iname = argv[1];
-    if (strcmp("-", argv[2]))
-        oname = argv[2];
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        char *end;
+        if (!strcmp(argv[i], "-h"))
+            exit_usage(0);
+        else if (argv[i][1] >= '1' && argv[i][1] <= '9') {
+            level = strtol(argv[i] + 1, &end, 10);
+            if (*end || level > LZ4HC_MAX_LEVEL)
+                exit_usage(1);
+        }
+        else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+            if ((accel = atoi(argv[++i])) < 1)
+                exit_usage(1);
+            level1_opts = 1;
+        }
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            memory = atoi(argv[++i]);
+            if (memory < LZ4_MEMORY_USAGE_MIN || memory > LZ4_MEMORY_USAGE_MAX)
+                exit_usage(1);
+            level1_opts = 1;
+        }
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            if ((nthreads = atoi(argv[++i])) < 1)
+                exit_usage(1);
+        }
+        else
+            exit_usage(1);
+    }
+    if (argc - i != 2)
+        exit_usage(1);
+    if (strcmp("-", argv[i]))
+        iname = argv[i];
+    if (strcmp("-", argv[i + 1]))
+        oname = argv[i + 1];
+    if (level1_opts && level >= LZ4HC_MIN_LEVEL)
+        ERR_CLEANUP("-a and -m apply only to level 1\n");
 
     /* read input file and allocate buffer for output file */
     if (!(idata = file_to_mem(iname, &isize)))
         ERR_CLEANUP("cannot read file '%s'\n", iname ? iname : "<stdin>");
-    if (!(odata = malloc(magic_size + decomp_size + LZ4_compressBound(isize))))
+    if (!(odata = malloc(magic_size + decomp_size + compress_bound(isize))))
         ERR_CLEANUP("cannot allocate memory for output\n");
 
     // write header and size of decompressed data at the beginning
@@ -140,7 +364,8 @@ int main(int argc, char **argv)
         odata[i] = (isize >> (8 * (i - magic_size))) & 0xff;
 
     /* compress */
-    if (!(csize = LZ4_compress(idata, odata + i, isize)))
+    if (!(csize = compress_block(idata, isize, (unsigned char *)odata + i, nthreads,
+                                level, accel, memory)))
         ERR_CLEANUP("compression failed\n");
     osize = csize + magic_size + decomp_size;
 
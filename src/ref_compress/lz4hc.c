@@ -0,0 +1,334 @@
+/*
+   lz4hc - High compression LZ4 block compressor for jsonlz4
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+
+/*
+   The match finder keeps, for each position of the last 64K, the distance to
+   the previous position with the same hash of 4 bytes, and walks this chain
+   to find the longest matches at a position.
+
+   Levels 2-9 take the longest match at each position, unless the next
+   position has a longer one (lazy parsing), and search longer chains.
+
+   Levels 10-12 find the cheapest encoding, in bytes, of up to OPT_NUM
+   positions at a time (optimal parsing): each position is reached either by
+   a literal from the one before it, or by a match which was found at a
+   position before it. A match longer than the level's sufficient length ends
+   the step and is taken as is, which bounds the work at each position.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4.h"
+#include "lz4hc.h"
+
+#define MINMATCH      4
+#define LASTLITERALS  5      /* a block ends with at least 5 literals */
+#define MFLIMIT       12     /* and its last match starts 12 bytes or more before its end */
+#define MAX_DISTANCE  65535
+#define HASH_LOG      15
+#define MAX_MATCHES   64     /* found at one position, of increasing lengths */
+#define OPT_NUM       2048   /* positions of one optimal parsing step */
+#define OPT_MATCHES   4      /* the longest matches at a position, which are priced */
+#define PRICE_MAX     0x7fffffff
+
+typedef struct {
+    int len, off;
+} match_t;
+
+typedef struct {
+    int price;   /* the bytes to encode the input up to here */
+    int len;     /* how it's reached: 1 for a literal, or a match length */
+    int off;
+    int litlen;  /* literals since the last match */
+} opt_t;
+
+typedef struct {
+    const unsigned char *base;  /* positions are offsets from base */
+    unsigned next;              /* the next position to insert */
+    int attempts;               /* the maximum chain length to search */
+    unsigned hash[1 << HASH_LOG];
+    unsigned short chain[65536];  /* by position & 0xffff */
+    opt_t opt[OPT_NUM];
+    int path[OPT_NUM / MINMATCH + 1];  /* match ends, in opt */
+} hc_t;
+
+/* chain length to search, and (for optimal parsing) the match length which
+ * is taken as is */
+static const struct {
+    int attempts, sufficient;
+} levels[LZ4HC_MAX_LEVEL + 1] = {
+    {0, 0}, {0, 0},
+    {2, 0}, {4, 0}, {8, 0}, {16, 0}, {32, 0}, {64, 0}, {128, 0}, {256, 0},
+    {512, 128}, {1024, 256}, {4096, 1024}
+};
+
+static unsigned hc_hash(const unsigned char *p)
+{
+    unsigned v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/* Adds the positions before p to the chains */
+static void hc_insert(hc_t *hc, const unsigned char *p)
+{
+    unsigned end = (unsigned)(p - hc->base);
+    for (; hc->next < end; hc->next++) {
+        unsigned h = hc_hash(hc->base + hc->next);
+        unsigned d = hc->next - hc->hash[h];
+        hc->chain[hc->next & 0xffff] = d > MAX_DISTANCE ? MAX_DISTANCE : d;
+        hc->hash[h] = hc->next;
+    }
+}
+
+/* Returns the length of the match of p and m, up to limit */
+static int hc_count(const unsigned char *p, const unsigned char *m, const unsigned char *limit)
+{
+    const unsigned char *start = p;
+    while (limit - p >= 8) {
+        unsigned long long a, b;
+        memcpy(&a, p, 8);
+        memcpy(&b, m, 8);
+        if (a != b)
+            break;
+        p += 8;
+        m += 8;
+    }
+    while (p < limit && *p == *m) {
+        p++;
+        m++;
+    }
+    return (int)(p - start);
+}
+
+/* Finds matches at ip, which end by limit, of increasing lengths from minlen,
+ * till one is longer than enough. Returns their number, and the longest is the
+ * last */
+static int hc_matches(hc_t *hc, const unsigned char *ip, const unsigned char *limit,
+                      int minlen, int enough, match_t *m)
+{
+    unsigned pos = (unsigned)(ip - hc->base), cand;
+    int attempts = hc->attempts, n = 0, best = minlen - 1;
+
+    hc_insert(hc, ip);
+    cand = hc->hash[hc_hash(ip)];
+    while (attempts-- > 0 && cand < pos && pos - cand <= MAX_DISTANCE && limit - ip > best) {
+        const unsigned char *c = hc->base + cand;
+        unsigned d;
+        if (c[best] == ip[best] && !memcmp(c, ip, MINMATCH)) {
+            int len = hc_count(ip, c, limit);
+            if (len > best) {
+                if (n == MAX_MATCHES)
+                    n--;  /* keep the longest */
+                m[n].len = best = len;
+                m[n++].off = pos - cand;
+                if (len > enough)
+                    break;
+            }
+        }
+        d = hc->chain[cand & 0xffff];
+        if (!d || d > cand)
+            break;
+        cand -= d;
+    }
+    return n;
+}
+
+/* Writes the literals from *anchor to ip, and the match (off, len) if len */
+static unsigned char *hc_sequence(unsigned char *op, const unsigned char **anchor,
+                                  const unsigned char *ip, int off, int len)
+{
+    size_t lits = ip - *anchor, n;
+    unsigned char *token = op++;
+
+    *token = (unsigned char)((lits < 15 ? lits : 15) << 4);
+    if (lits >= 15) {
+        for (n = lits - 15; n >= 255; n -= 255)
+            *op++ = 255;
+        *op++ = (unsigned char)n;
+    }
+    memcpy(op, *anchor, lits);
+    op += lits;
+    *anchor = ip + len;
+    if (!len)
+        return op;
+
+    *op++ = (unsigned char)off;
+    *op++ = (unsigned char)(off >> 8);
+    len -= MINMATCH;
+    *token |= len < 15 ? len : 15;
+    if (len >= 15) {
+        for (len -= 15; len >= 255; len -= 255)
+            *op++ = 255;
+        *op++ = (unsigned char)len;
+    }
+    return op;
+}
+
+/* The bytes of a literals run (without the token), and of a match */
+static int lit_price(int lits)
+{
+    return lits + (lits >= 15 ? (lits - 15) / 255 + 1 : 0);
+}
+
+static int match_price(int len)
+{
+    len -= MINMATCH;
+    return 1 + 2 + (len >= 15 ? (len - 15) / 255 + 1 : 0);
+}
+
+/* Compresses with lazy parsing, or optimal parsing if sufficient. Returns the
+ * end of the output */
+static unsigned char *hc_compress(hc_t *hc, const unsigned char *src, int size,
+                                  unsigned char *op, int sufficient)
+{
+    const unsigned char *ip = src, *anchor = src, *iend = src + size;
+    const unsigned char *mflimit = iend - MFLIMIT, *limit = iend - LASTLITERALS;
+    match_t m[MAX_MATCHES];
+    opt_t *opt = hc->opt;
+    int n, enough = sufficient ? sufficient : size;  /* a longer match is taken as is */
+
+    if (size <= MFLIMIT)
+        return hc_sequence(op, &anchor, iend, 0, 0);  /* too short for a match */
+
+    while (ip < mflimit) {
+        int r, k, last, len, off, tail_len = 0, tail_off = 0;
+
+        if (!(n = hc_matches(hc, ip, limit, MINMATCH, enough, m))) {
+            ip++;
+            continue;
+        }
+        len = m[n - 1].len;
+        off = m[n - 1].off;
+
+        if (!sufficient || len > sufficient) {
+            /* lazy: a literal, if the next position has a longer match */
+            while (!sufficient && ip + 1 < mflimit && (n = hc_matches(hc, ip + 1, limit, len + 1, enough, m))) {
+                ip++;
+                len = m[n - 1].len;
+                off = m[n - 1].off;
+            }
+            op = hc_sequence(op, &anchor, ip, off, len);
+            ip += len;
+            continue;
+        }
+
+        /* optimal: the cheapest way to reach each position from ip */
+        opt[0].price = lit_price((int)(ip - anchor));
+        opt[0].len = 0;
+        opt[0].litlen = (int)(ip - anchor);
+        last = 0;
+        for (r = 0; r <= last; r++) {
+            const unsigned char *p = ip + r;
+            if (r) {
+                int price = opt[r - 1].price - lit_price(opt[r - 1].litlen) + lit_price(opt[r - 1].litlen + 1);
+                if (price < opt[r].price) {
+                    opt[r].price = price;
+                    opt[r].len = 1;
+                    opt[r].litlen = opt[r - 1].litlen + 1;
+                }
+                /* skip the search if a match through p is already as cheap */
+                if (r < last && opt[r + 1].price <= opt[r].price)
+                    continue;
+                if (p >= mflimit || !(n = hc_matches(hc, p, limit, MINMATCH, enough, m)))
+                    continue;
+            }
+            if (m[n - 1].len > sufficient || r + m[n - 1].len >= OPT_NUM) {
+                /* a long match ends the step */
+                tail_len = m[n - 1].len;
+                tail_off = m[n - 1].off;
+                last = r;
+                break;
+            }
+            /* a match costs the same as a shorter one of the same length, so
+             * price the lengths which fit the token (up to MINMATCH + 14), and
+             * past them only the lengths of the longest OPT_MATCHES matches */
+            for (k = 0, len = MINMATCH; len <= m[n - 1].len; len++) {
+                int price;
+                while (m[k].len < len)
+                    k++;
+                if (len > MINMATCH + 14) {
+                    if (k < n - OPT_MATCHES)
+                        k = n - OPT_MATCHES;
+                    len = m[k].len;
+                }
+                price = opt[r].price + match_price(len);
+                for (; last < r + len; last++)
+                    opt[last + 1].price = PRICE_MAX;
+                if (price < opt[r + len].price) {
+                    opt[r + len].price = price;
+                    opt[r + len].len = len;
+                    opt[r + len].off = m[k].off;
+                    opt[r + len].litlen = 0;
+                }
+            }
+        }
+
+        /* the matches of the cheapest path to last, found backwards */
+        for (k = 0, r = last; r > 0; r -= opt[r].len) {
+            if (opt[r].len > 1)
+                hc->path[k++] = r;
+        }
+        while (k--) {
+            r = hc->path[k];
+            op = hc_sequence(op, &anchor, ip + r - opt[r].len, opt[r].off, opt[r].len);
+        }
+        if (tail_len) {
+            op = hc_sequence(op, &anchor, ip + last, tail_off, tail_len);
+            ip += last + tail_len;
+        } else {
+            ip += last;
+        }
+    }
+    return hc_sequence(op, &anchor, iend, 0, 0);
+}
+
+int LZ4HC_compress_prefix(const char *src, char *dst, int srcSize, int prefixSize, int level)
+{
+    hc_t *hc;
+    unsigned char *end;
+
+    if (level < LZ4HC_MIN_LEVEL || level > LZ4HC_MAX_LEVEL || prefixSize < 0
+        || srcSize < 0 || srcSize > LZ4_MAX_INPUT_SIZE || !(hc = calloc(1, sizeof *hc)))
+        return 0;
+    if (prefixSize > 64 * 1024)
+        prefixSize = 64 * 1024;
+
+    hc->base = (const unsigned char *)src - prefixSize;
+    hc->attempts = levels[level].attempts;
+    end = hc_compress(hc, (const unsigned char *)src, srcSize, (unsigned char *)dst,
+                      levels[level].sufficient);
+
+    free(hc);
+    return (int)(end - (unsigned char *)dst);
+}
@@ -0,0 +1,60 @@
+/*
+   lz4hc - High compression LZ4 block compressor for jsonlz4
+   Copyright (C) 2016, Avi Halachmi
+   BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+       * Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+       * Redistributions in binary form must reproduce the above
+   copyright notice, this list of conditions and the following disclaimer
+   in the documentation and/or other materials provided with the
+   distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+   You can contact the author at :
+   - Repository: https://github.com/avih/dejsonlz4
+*/
+#pragma once
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+
+/*
+   Slower compression into smaller, standard LZ4 blocks: a hash chain match
+   finder, with lazy parsing at levels 2-9 and optimal parsing at 10-12.
+   Level 1 is LZ4_compress() of lz4.c.
+*/
+#define LZ4HC_MIN_LEVEL  2
+#define LZ4HC_MAX_LEVEL  12
+
+/*
+LZ4HC_compress_prefix() :
+    Compresses src of srcSize bytes into dst, which must hold
+    LZ4_compressBound(srcSize) bytes, at level LZ4HC_MIN_LEVEL..LZ4HC_MAX_LEVEL.
+    The prefixSize bytes before src (up to 64 KB are used) are a dictionary,
+    e.g. the previous part of the same input.
+    return : the compressed size, or 0 on failure (bad level or size, or OOM).
+*/
+int LZ4HC_compress_prefix(const char *src, char *dst, int srcSize, int prefixSize, int level);
+
+
+#if defined (__cplusplus)
+}
+#endif
@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+"""
+Regression checks of dejsonlz4: builds it, jsonlz4 and dejsonlz4-gen with $CC
+(default gcc) in a temporary directory, and compares their output with Python's
+json module (and with jq for --select, if it's installed).
+
+Usage: python3 tests/check.py [-k]
+   -k  Keep the temporary directory.
+Exits with 1 if any check fails.
+"""
+import csv, io, json, os, random, re, shutil, subprocess, sys, tempfile
+
+SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src')
+R = random.Random(1)
+failed = 0
+
+
+def fail(what, detail=''):
+    global failed
+    failed += 1
+    print('FAIL: %s %s' % (what, str(detail)[:300]))
+
+
+def run(*args, **kw):
+    return subprocess.run([a if isinstance(a, bytes) else str(a) for a in args], capture_output=True, **kw)
+
+
+def out(*args, **kw):
+    r = run(*args, **kw)
+    if r.returncode or r.stderr:
+        fail(' '.join(str(a) for a in args), r.stderr)
+    return r.stdout
+
+
+def build(tmp):
+    cc = os.environ.get('CC', 'gcc').split()
+    s = lambda *f: [os.path.join(SRC, x) for x in f]
+    for name, files, flags in (
+            ('dejsonlz4', s('dejsonlz4.c', 'mozlz4.c', 'json.c', 'lz4.c'), ['-pthread']),
+            ('jsonlz4', s('ref_compress/jsonlz4.c', 'lz4.c', 'ref_compress/lz4hc.c'), ['-pthread', '-I' + SRC]),
+            ('dejsonlz4-gen', s('bench/dejsonlz4-gen.c', 'lz4.c'), ['-I' + SRC])):
+        r = subprocess.run(cc + ['-Wall', '-O2'] + flags + ['-o', os.path.join(tmp, name)] + files)
+        if r.returncode:
+            sys.exit('cannot build %s' % name)
+    return [os.path.join(tmp, n) for n in ('dejsonlz4', 'jsonlz4', 'dejsonlz4-gen')]
+
+
+def compress(jz, text, path, level=1):
+    with open(path + '.in', 'wb') as f:
+        f.write(text)
+    out(jz, '-%d' % level, path + '.in', path)
+    return path
+
+
+def rnd_str():
+    return ''.join(R.choice(['a', 'b', ' ', '/', '\t', '\n', '"', '\\', ',', 'é', '日', '\U0001F600', '\r'])
+                   for _ in range(R.randint(0, 8)))
+
+
+def rnd_val(d):
+    r = R.random()
+    if d > 4 or r < 0.3:
+        return R.choice([1, -2500, 12345678901234, True, False, None, '', 'plain', rnd_str()])
+    if r < 0.65:
+        return {R.choice(['a', 'b', 'uri', 'a b', 'k"q']) + str(R.randint(0, 1)): rnd_val(d + 1)
+                for _ in range(R.randint(0, 4))}
+    return [rnd_val(d + 1) for _ in range(R.randint(0, 4))]
+
+
+def check_roundtrip(dej, jz, gen, tmp):
+    """The whole output, in each mode, is the compressed JSON"""
+    big = os.path.join(tmp, 'big.jsonlz4')
+    out(gen, '-z', 'bookmarks', '-b', 30000, big)
+    text = out(gen, 'bookmarks', '-b', 30000, '-')
+    files = {'gen': big, 'level 9': compress(jz, text, os.path.join(tmp, 'l9.jsonlz4'), 9)}
+    files['session'] = os.path.join(tmp, 'session.jsonlz4')
+    out(gen, '-z', 'session', '-t', 3000, files['session'])
+    stext = out(gen, 'session', '-t', 3000, '-')
+    for name, f in files.items():
+        exp = stext if name == 'session' else text
+        for opts in ([], ['-s'], ['-p', 4]):
+            if out(dej, *(opts + [f])) != exp:
+                fail('round-trip %s %s' % (name, opts))
+            o = os.path.join(tmp, 'o.json')
+            out(dej, *(opts + [f, o]))
+            if open(o, 'rb').read() != exp:
+                fail('round-trip to a file %s %s' % (name, opts))
+        if out(dej, '-', input=open(f, 'rb').read()) != exp:
+            fail('round-trip from stdin %s' % name)
+        if out(dej, '--head', 100000, f) != exp[:100000]:
+            fail('--head %s' % name)
+
+    # batch: X.jsonlz4 is written to X.json
+    d = os.path.join(tmp, 'batch')
+    os.mkdir(d)
+    shutil.copy(big, d)
+    shutil.copy(files['session'], d)
+    out(dej, '-j', 2, '-r', d)
+    if (open(os.path.join(d, 'big.json'), 'rb').read() != text
+            or open(os.path.join(d, 'session.json'), 'rb').read() != stext):
+        fail('-j -r round-trip')
+    return big, text
+
+
+def check_format(dej, jz, tmp):
+    """--pretty and --minify write the same values, indented or compact"""
+    for n in range(100):
+        v = rnd_val(0)
+        ea = R.random() < 0.5
+        f = compress(jz, json.dumps(v, indent=R.choice([None, 1, '\t']), ensure_ascii=ea).encode(),
+                     os.path.join(tmp, 'f.jsonlz4'))
+        pretty = out(dej, '--pretty', f).decode()
+        minify = out(dej, '--minify', f).decode()
+        if pretty != json.dumps(v, indent=2, ensure_ascii=ea) + '\n':
+            fail('--pretty', pretty)
+        if minify != json.dumps(v, separators=(',', ':'), ensure_ascii=ea):
+            fail('--minify', minify)
+
+
+def check_select(dej, jz, tmp):
+    """--select gives the values which jq gives, including null for missing ones"""
+    if not shutil.which('jq'):
+        print('skipped --select: jq is not installed')
+        return
+    paths = ['.', '.a0', '.a0[]', '.[]', '.[1].b1', '."a b0"', '."k\\"q1"[]', '.a1.b0[0]', '.[][]', '.[3]']
+    for n in range(60):
+        v = rnd_val(0)
+        text = json.dumps(v, indent=R.choice([None, 2]), ensure_ascii=R.random() < 0.5).encode()
+        f = compress(jz, text, os.path.join(tmp, 's.jsonlz4'))
+        for p in paths:
+            # jq fails on wrong types, where --select gives nothing: compare only if it succeeds
+            ref = run('jq', '-c', p, input=text)
+            if ref.returncode:
+                continue
+            exp = [json.loads(l) for l in ref.stdout.decode().splitlines()]
+            got = [json.loads(l) for l in out(dej, '--select', p, f).decode().splitlines()]
+            if got != exp:
+                fail('--select %s' % p, text)
+            if not any(isinstance(e, str) and '\n' in e for e in exp):
+                # the other values are written as without --raw
+                lines = out(dej, '--select', p, f).decode().split('\n')
+                raw = out(dej, '--select', p, '--raw', f).decode().split('\n')
+                if raw != [e if isinstance(e, str) else l for e, l in zip(exp, lines)] + ['']:
+                    fail('--select %s --raw' % p, text)
+
+
+def rnd_node(d):
+    o = {'guid': rnd_str(), 'title': rnd_str(), 'dateAdded': R.randint(0, 10 ** 16),
+         'lastModified': R.randint(0, 10 ** 16)}
+    if d < 3 and R.random() < 0.4:
+        o['children'] = [rnd_node(d + 1) for _ in range(R.randint(0, 4))]
+    else:
+        o['uri'] = 'http://' + rnd_str()
+        if R.random() < 0.3:
+            o['tags'] = rnd_str()
+    return o
+
+
+def export_rows(doc):
+    """(path, [title, uri, dateAdded, lastModified, tags]) for each bookmark"""
+    rows = []
+
+    def walk(o, path, top):
+        if 'children' in o:
+            for c in o['children']:
+                walk(c, path if top else path + '/' + o['title'], False)
+        elif 'uri' in o:
+            rows.append((path, [o.get(k) for k in ('title', 'uri', 'dateAdded', 'lastModified', 'tags')]))
+    walk(doc, '', True)
+    return rows
+
+
+def check_export(dej, jz, tmp):
+    """--export writes a row per bookmark, with its folders path"""
+    esc = lambda s: s.replace('\\', '\\\\').replace('\t', '\\t').replace('\n', '\\n').replace('\r', '\\r')
+    for n in range(100):
+        doc = rnd_node(0)
+        f = compress(jz, json.dumps(doc, indent=R.choice([None, 1]), ensure_ascii=R.random() < 0.5).encode(),
+                     os.path.join(tmp, 'e.jsonlz4'))
+        rows = [(p, ['' if x is None else str(x) for x in r]) for p, r in export_rows(doc)]
+        tsv = out(dej, '--export', 'tsv', f).decode().split('\n')
+        if tsv != ['path\ttitle\turi\tdateAdded\tlastModified\ttags'] + ['\t'.join(esc(x) for x in [p] + r)
+                                                                      for p, r in rows] + ['']:
+            fail('--export tsv', doc)
+        got = list(csv.reader(io.StringIO(out(dej, '--export', 'csv', f).decode(), newline='')))
+        if got != [['path', 'title', 'uri', 'dateAdded', 'lastModified', 'tags']] + [[p] + r for p, r in rows]:
+            fail('--export csv', doc)
+        got = [json.loads(l) for l in out(dej, '--export', 'ndjson', f).decode().splitlines()]
+        if got != [dict(zip(('path', 'title', 'uri', 'dateAdded', 'lastModified', 'tags'), [p] + r))
+                   for p, r in export_rows(doc)]:
+            fail('--export ndjson', doc)
+        if out(dej, '--export', 'uri', f).decode().split('\n') != [esc(r[1]) for p, r in rows] + ['']:
+            fail('--export uri', doc)
+
+
+def check_grep(dej, big, text, tmp):
+    """--grep prints the offset of each match, and -l the files with one"""
+    other = os.path.join(tmp, 'other.jsonlz4')
+    shutil.copy(big, other)
+    pats = [b'"uri"', b'zzzz_not_there', '日'.encode(), text[65531:65545]]
+    pats += [text[o:o + R.choice([2, 9, 300])] for o in R.sample(range(len(text) - 300), 4)]
+    for pat in pats:
+        if pat.startswith(b'-') or b'\0' in pat:
+            continue
+        exp, i = [], text.find(pat)
+        while i >= 0:
+            exp.append(i)
+            i = text.find(pat, i + len(pat))
+        r = run(dej, '--grep', pat, big, other)
+        got = r.stdout.decode().splitlines()
+        if r.returncode != (0 if exp else 1) or got != ['%s:%d' % (f, i) for f in (big, other) for i in exp]:
+            fail('--grep', pat)
+        got = run(dej, '--grep', pat, '-l', '-j', 2, big, other).stdout.decode().splitlines()
+        if sorted(got) != (sorted([big, other]) if exp else []):
+            fail('--grep -l', pat)
+
+
+def check_range(dej, big, text, tmp):
+    """--range gives the slice of the output, with and without an index"""
+    f = os.path.join(tmp, 'range.jsonlz4')
+    shutil.copy(big, f)
+    ranges = [(0, 10), (len(text) - 5, 100), (1 << 20, 1), ((1 << 20) - 3, 70000)]
+    ranges += [(R.randrange(len(text)), R.choice([1, 1000, 200000])) for _ in range(6)]
+    for index in (0, 1):
+        if index:
+            out(dej, '--build-index', f)
+        for off, n in ranges:
+            # without the index, it warns that it decompresses from the start
+            r = run(dej, '--range', '%d:%d' % (off, n), f)
+            if r.returncode or bool(r.stderr) == index or r.stdout != text[off:off + n]:
+                fail('--range %d:%d%s' % (off, n, ' with an index' if index else ''))
+
+
+def check_urls(dej, gen, tmp):
+    """--url-lookup finds the first and the last backups with a URL"""
+    d = os.path.join(tmp, 'backups')
+    os.mkdir(d)
+    backups = []
+    for i in range(4):
+        f = os.path.join(d, 'bookmarks-2023-0%d-01_100_x.jsonlz4' % (i + 1))
+        out(gen, '-z', '--seed', i % 3 + 1, 'bookmarks', '-b', 300, f)
+        backups.append(f)
+    idx = os.path.join(tmp, 'urls.idx')
+    have = {}
+    for f in backups:
+        for u in out(dej, '--export', 'uri', f).decode().splitlines():
+            if f not in have.setdefault(u, []):
+                have[u].append(f)
+
+    def lookups(files):
+        for u in R.sample(sorted(have), 30) + ['http://not.there/']:
+            fs = [f for f in have.get(u, []) if f in files]
+            r = run(dej, '--url-lookup', idx, u)
+            exp = ['first: %s %s' % (fs[0][-24:-14], fs[0]), 'last:  %s %s' % (fs[-1][-24:-14], fs[-1]),
+                   'files: %d' % len(fs)] if fs else []
+            if r.stdout.decode().splitlines() != exp or r.returncode != (0 if fs else 1):
+                fail('--url-lookup %s' % u, r.stdout)
+
+    out(dej, '--url-index', idx, *backups)
+    lookups(backups)
+    # updated without the first backup, which is removed from it
+    out(dej, '--url-index', idx, '-j', 2, *backups[1:])
+    lookups(backups[1:])
+    # normalized: the scheme and host case, the default port and the fragment
+    u = next(u for u in sorted(have) if re.match(r'http://[^/]+/$', u))
+    r = run(dej, '--url-lookup', idx, 'HTTP://' + u[7:-1].upper() + ':80/#top')
+    if r.stdout != run(dej, '--url-lookup', idx, u).stdout:
+        fail('--url-lookup normalization', u)
+
+
+def main():
+    tmp = tempfile.mkdtemp(prefix='dejsonlz4-check.')
+    try:
+        dej, jz, gen = build(tmp)
+        big, text = check_roundtrip(dej, jz, gen, tmp)
+        check_format(dej, jz, tmp)
+        check_select(dej, jz, tmp)
+        check_export(dej, jz, tmp)
+        check_grep(dej, big, text, tmp)
+        check_range(dej, big, text, tmp)
+        check_urls(dej, gen, tmp)
+    finally:
+        if '-k' in sys.argv[1:]:
+            print('kept %s' % tmp)
+        else:
+            shutil.rmtree(tmp)
+    print('%d failed' % failed if failed else 'all passed')
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())